@@ -0,0 +1,266 @@
+#include "../include/map.hpp"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Every benchmark uses the same seed so runs are comparable across builds
+#define BENCHMARK_SEED 1
+#define BENCHMARK_WORD "abcdefghijklmnop"
+
+/**
+ * @brief Peak resident memory of the process so far in kilobytes, run a single benchmark
+ * with --benchmark_filter to get the peak of just that phase
+ */
+static double get_peak_memory_kb(){
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+static void report_cells(benchmark::State &state, int cell_count){
+    state.counters["cells_per_second"] = benchmark::Counter(cell_count, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["peak_memory_kb"] = get_peak_memory_kb();
+}
+
+// Generating, solving and drawing over square grids at 2px blocks, the reported complexity should come out as O(N) in cell count
+static void BM_MazeGeneration(benchmark::State &state){
+    int grid_size = state.range(0);
+
+    for(auto _ : state){
+        Maze maze(grid_size, grid_size, 2, 2, BENCHMARK_SEED);
+        benchmark::DoNotOptimize(maze.solution_path);
+    }
+
+    state.SetComplexityN(grid_size * grid_size);
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_MazeGeneration)->RangeMultiplier(2)->Range(16, 256)->Unit(benchmark::kMillisecond)->Complexity(benchmark::oN);
+
+// Each engine carving a full square grid on its own, args are the generator type and grid size
+static void BM_Generator(benchmark::State &state){
+    GeneratorType generator_type = GeneratorType(state.range(0));
+    int grid_size = state.range(1);
+    std::unique_ptr<MazeGenerator> generator(create_generator(generator_type));
+    RandomContext random(BENCHMARK_SEED);
+
+    for(auto _ : state){
+        CarveRegion region(grid_size, grid_size);
+        std::vector<Passage> passages;
+
+        std::fill(region.cell_states.begin(), region.cell_states.end(), REGION_CARVABLE);
+        region.cell_states[0] = REGION_ROOT;
+
+        generator->carve(region, random, passages);
+        benchmark::DoNotOptimize(passages.data());
+    }
+
+    state.SetLabel(generator->get_name());
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_Generator)->ArgsProduct({{GrowingTree, Backtracker, Wilson, Kruskal}, {64, 256, 1024}})->Unit(benchmark::kMillisecond);
+
+// The breadth first solve on its own, over an already generated grid
+static void BM_SolveMaze(benchmark::State &state){
+    int grid_size = state.range(0);
+    Maze maze(grid_size, grid_size, 1, 1, BENCHMARK_SEED, false);
+
+    for(auto _ : state){
+        maze.solve_maze();
+        benchmark::DoNotOptimize(maze.solution_path);
+    }
+
+    state.SetComplexityN(grid_size * grid_size);
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_SolveMaze)->RangeMultiplier(2)->Range(16, 1024)->Unit(benchmark::kMillisecond)->Complexity(benchmark::oN);
+
+// Applying a word to a solved maze, args are the grid size and word length. A Maze built with the
+// same seed is the word maze before its word went on, so it is copied into the word maze and room
+// is made for the word once, then those blocks and random state are copied back in before every run.
+static void BM_ApplyWord(benchmark::State &state){
+    int grid_size = state.range(0), block_count = grid_size * grid_size;
+    std::string word = std::string(BENCHMARK_WORD).substr(0, state.range(1));
+    Maze skeleton(grid_size, grid_size, 1, 1, BENCHMARK_SEED, false);
+    WordMaze word_maze(word, grid_size, grid_size, 1, 1, BENCHMARK_SEED, false);
+
+    memcpy(word_maze.map->block_grid, skeleton.map->block_grid, sizeof(Block) * block_count);
+    word_maze.random = skeleton.random;
+    word_maze.map_start = &word_maze.map->block_grid[skeleton.map->get_block_index(skeleton.map_start)];
+    word_maze.map_end = &word_maze.map->block_grid[skeleton.map->get_block_index(skeleton.map_end)];
+    word_maze.solve_maze();
+    word_maze.make_room_for_word();
+
+    std::vector<Block> prepared_blocks(word_maze.map->block_grid, word_maze.map->block_grid + block_count);
+    RandomContext prepared_random = word_maze.random;
+
+    for(auto _ : state){
+        state.PauseTiming();
+        memcpy(word_maze.map->block_grid, prepared_blocks.data(), sizeof(Block) * block_count);
+        word_maze.random = prepared_random;
+        state.ResumeTiming();
+
+        word_maze.apply_word();
+        benchmark::DoNotOptimize(word_maze.map->block_grid);
+    }
+
+    report_cells(state, block_count);
+}
+BENCHMARK(BM_ApplyWord)->ArgsProduct({{32, 128, 512}, {2, 4, 8, 16}})->Unit(benchmark::kMillisecond);
+
+// A full redraw of every block, args are the grid size and block size
+static void BM_MapDraw(benchmark::State &state){
+    int grid_size = state.range(0), block_size = state.range(1);
+    Maze maze(grid_size, grid_size, block_size, block_size, BENCHMARK_SEED);
+
+    for(auto _ : state){
+        maze.map->mark_all_blocks_changed();
+        benchmark::DoNotOptimize(maze.map->draw());
+    }
+
+    state.counters["pixels_per_second"] = benchmark::Counter(maze.map->width * maze.map->height, benchmark::Counter::kIsIterationInvariantRate);
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_MapDraw)->ArgsProduct({{32, 128}, {5, 10, 20, 40}})->Unit(benchmark::kMillisecond);
+
+// Blending one letter onto a block, the arg is the block size
+static void BM_ApplyLetter(benchmark::State &state){
+    int block_size = state.range(0);
+    std::shared_ptr<GlyphAtlas> glyph_atlas = get_font_cache().get_glyph_atlas(block_size, block_size);
+
+    if(!glyph_atlas){
+        state.SkipWithError("Couldn't load the font");
+        return;
+    }
+
+    Drawable2D block_canvas(block_size, block_size, glyph_atlas.get());
+    block_canvas.fill(COLOR_WHITE);
+
+    for(auto _ : state){
+        block_canvas.apply_letter_to_drawable('m');
+        benchmark::DoNotOptimize(block_canvas.pixels);
+    }
+
+    state.counters["pixels_per_second"] = benchmark::Counter(block_size * block_size, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["peak_memory_kb"] = get_peak_memory_kb();
+}
+BENCHMARK(BM_ApplyLetter)->Arg(5)->Arg(10)->Arg(20)->Arg(40)->Unit(benchmark::kMicrosecond);
+
+// Encoding and writing a whole map, args are the grid size and image format
+static void BM_SaveToPng(benchmark::State &state){
+    int grid_size = state.range(0);
+    PngWriter::ImageOptions options(PngWriter::ImageFormat(state.range(1)));
+    std::string filename = "benchmark_maze" + PngWriter::get_file_extension(options.format);
+    Maze maze(grid_size, grid_size, 20, 20, BENCHMARK_SEED);
+
+    for(auto _ : state){
+        maze.save_to_png(filename, options);
+    }
+
+    remove(filename.c_str());
+    state.counters["pixels_per_second"] = benchmark::Counter(maze.map->width * maze.map->height, benchmark::Counter::kIsIterationInvariantRate);
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_SaveToPng)->ArgsProduct({{20, 100}, {PngWriter::RGBA, PngWriter::Palette, PngWriter::Gray1, PngWriter::Raw}})->Unit(benchmark::kMillisecond);
+
+// Turning a drawn map into scanlines without compressing them, the arg is the image format. This is
+// the part of encoding the pixel kernels speed up, the instruction set they use is reported.
+static void BM_ConvertRows(benchmark::State &state){
+    PngWriter::ImageFormat format = PngWriter::ImageFormat(state.range(0));
+    Maze maze(100, 100, 20, 20, BENCHMARK_SEED);
+    PngWriter::PngLayout layout(format, maze.map->width);
+
+    if(format == PngWriter::Palette) layout.build_palette(maze.map->pixels, (size_t)maze.map->width * maze.map->height);
+    std::vector<uint8_t> row(layout.get_row_bytes());
+
+    for(auto _ : state){
+        for(int y = 0; y < maze.map->height; y++){
+            layout.convert_row(maze.map->get_pixel(0, y), row.data());
+        }
+        benchmark::DoNotOptimize(row.data());
+    }
+
+    state.SetLabel(PixelKernels::get_instruction_set_name());
+    state.counters["pixels_per_second"] = benchmark::Counter(maze.map->width * maze.map->height, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_ConvertRows)->Arg(PngWriter::RGB)->Arg(PngWriter::Palette)->Arg(PngWriter::Gray1)->Unit(benchmark::kMillisecond);
+
+// Everything a call from Python does, args are the grid size and word length
+static void BM_WordMaze(benchmark::State &state){
+    int grid_size = state.range(0);
+    std::string word = std::string(BENCHMARK_WORD).substr(0, state.range(1));
+
+    // The font and atlas are loaded once per process, get them out of the way before timing
+    if(!get_font_cache().get_glyph_atlas(20, 20)){
+        state.SkipWithError("Couldn't load the font");
+        return;
+    }
+
+    for(auto _ : state){
+        WordMaze word_maze(word, grid_size, grid_size, 20, 20, BENCHMARK_SEED);
+        benchmark::DoNotOptimize(word_maze.map->pixels);
+    }
+
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_WordMaze)->ArgsProduct({{20, 50}, {4, 8, 16}})->Unit(benchmark::kMillisecond);
+
+// What a call left with a pooled skeleton does, copying it and putting the word on, args are the
+// grid size and word length. The difference from BM_WordMaze is what the skeleton pool saves.
+static void BM_WordMazeFromSkeleton(benchmark::State &state){
+    int grid_size = state.range(0);
+    std::string word = std::string(BENCHMARK_WORD).substr(0, state.range(1));
+    Maze skeleton(grid_size, grid_size, 1, 1, BENCHMARK_SEED, false);
+
+    if(!get_font_cache().get_glyph_atlas(20, 20)){
+        state.SkipWithError("Couldn't load the font");
+        return;
+    }
+
+    for(auto _ : state){
+        WordMaze word_maze(word, skeleton, 20, 20);
+        benchmark::DoNotOptimize(word_maze.map->pixels);
+    }
+
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_WordMazeFromSkeleton)->ArgsProduct({{20, 50}, {4, 8, 16}})->Unit(benchmark::kMillisecond);
+
+// Packing a finished word maze into its stored form, the arg is the grid size
+static void BM_SerializeMaze(benchmark::State &state){
+    int grid_size = state.range(0);
+    WordMaze word_maze(BENCHMARK_WORD, grid_size, grid_size, 1, 1, BENCHMARK_SEED, false);
+
+    for(auto _ : state){
+        std::vector<uint8_t> data = word_maze.serialize();
+        benchmark::DoNotOptimize(data.data());
+    }
+
+    state.counters["bytes"] = word_maze.serialize().size();
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_SerializeMaze)->Arg(20)->Arg(128)->Arg(512)->Unit(benchmark::kMicrosecond);
+
+// Reading a stored word maze back without drawing it, compare against BM_WordMaze for what
+// loading saves over generating. The arg is the grid size.
+static void BM_DeserializeMaze(benchmark::State &state){
+    int grid_size = state.range(0);
+    std::vector<uint8_t> data = WordMaze(BENCHMARK_WORD, grid_size, grid_size, 1, 1, BENCHMARK_SEED, false).serialize();
+
+    for(auto _ : state){
+        std::unique_ptr<WordMaze> word_maze(WordMaze::deserialize(data.data(), data.size(), 1, 1, false));
+        benchmark::DoNotOptimize(word_maze.get());
+    }
+
+    report_cells(state, grid_size * grid_size);
+}
+BENCHMARK(BM_DeserializeMaze)->Arg(20)->Arg(128)->Arg(512)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
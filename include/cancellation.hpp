@@ -0,0 +1,65 @@
+#include <atomic>
+#include <cstddef>
+
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+namespace Cancellation{
+/**
+ * @brief Set from any thread to ask the work it was handed to stop. Long loops poll it and
+ * return early, leaving whatever they were building unfinished, so the owner has to check
+ * is_cancelled once the work returns and throw the result away.
+ */
+struct Token{
+    std::atomic<bool> cancelled;
+
+    Token(): cancelled(false){}
+
+    void cancel(){
+        cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    bool is_cancelled(){
+        return cancelled.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief The token for the calling thread, NULL when the work can't be cancelled
+ */
+Token*& active_token(){
+    static thread_local Token *token = NULL;
+    return token;
+}
+
+/**
+ * @brief Make a token the calling thread's for as long as the scope lives
+ */
+struct TokenScope{
+    Token *previous_token;
+
+    TokenScope(Token *token): previous_token(active_token()){
+        active_token() = token;
+    }
+
+    ~TokenScope(){
+        active_token() = previous_token;
+    }
+};
+
+bool is_cancelled(){
+    Token *token = active_token();
+    return token && token->is_cancelled();
+}
+
+/**
+ * @brief Cheap enough for inner loops, only looks at the token once every 4096 steps
+ *
+ * @param step A count that goes up by one every iteration
+ */
+bool is_cancelled(size_t step){
+    return (step & 4095) == 0 && is_cancelled();
+}
+}
+
+#endif
@@ -1,8 +1,18 @@
-#include <SFML/Graphics.hpp>
-#include <SFML/Window.hpp>
 #include "utils.hpp"
+#include "font.hpp"
+#include "png_writer.hpp"
+#include "pixel_kernels.hpp"
+#include "instrumentation.hpp"
 #include <iostream>
-#include <csignal>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
 
 #ifndef DRAWABLE_H
 #define DRAWABLE_H
@@ -29,10 +39,10 @@ struct Color{
         return local_value;
     }
 
-    static Color* get_random_color(){
-        int r = get_rand_int(0, 255);
-        int g = get_rand_int(0, 255);
-        int b = get_rand_int(0, 255);
+    static Color* get_random_color(RandomContext &random){
+        int r = random.get_rand_int(0, 255);
+        int g = random.get_rand_int(0, 255);
+        int b = random.get_rand_int(0, 255);
 
         return new Color(r,g,b);
     }
@@ -45,48 +55,156 @@ struct Color{
 #define COLOR_BLUE Color(0, 0, 255)
 #define COLOR_GREEN Color(0, 255, 0)
 
+/**
+ * @brief Letters rasterized once for a block size and kept as alpha masks, so lettering
+ * a block is a CPU blend instead of a round trip through a render texture. Atlases are
+ * shared between threads, letters outside a to z are rasterized under a lock the first
+ * time they are asked for.
+ */
+struct GlyphAtlas{
+private:
+    std::vector<uint8_t> glyph_masks[256];
+    std::atomic<bool> glyph_ready[256];
+    std::mutex rasterize_mutex;
+    // Keeps a shared font alive for as long as the atlas
+    std::shared_ptr<Font> font_owner;
+public:
+    Font *font;
+    int width, height;
+
+    GlyphAtlas(Font *font, int width, int height): font(font), width(width), height(height){
+        rasterize_common_letters();
+    }
+
+    GlyphAtlas(std::shared_ptr<Font> font, int width, int height): font_owner(font), font(font.get()), width(width), height(height){
+        rasterize_common_letters();
+    }
+
+    GlyphAtlas(const GlyphAtlas&) = delete;
+    GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+    void rasterize_common_letters(){
+        MAZE_PHASE("rasterize_glyphs");
+        for(int letter = 0; letter < 256; letter++){
+            glyph_ready[letter] = false;
+        }
+        for(char letter = 'a'; letter <= 'z'; letter++){
+            rasterize_letter(letter);
+        }
+    }
+
+    void rasterize_letter(char letter){
+        std::vector<uint8_t> &mask = glyph_masks[(uint8_t)letter];
+
+        mask.resize((size_t)width * height);
+        font->rasterize_letter(letter, width, height, mask.data());
+        glyph_ready[(uint8_t)letter].store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Get the alpha mask for a letter, rasterizing it the first time it is asked for
+     *
+     * @param letter The letter
+     * @return uint8_t* width * height coverage values
+     */
+    uint8_t* get_glyph(char letter){
+        if(!glyph_ready[(uint8_t)letter].load(std::memory_order_acquire)){
+            std::lock_guard<std::mutex> lock(rasterize_mutex);
+            if(!glyph_ready[(uint8_t)letter].load(std::memory_order_relaxed)) rasterize_letter(letter);
+        }
+
+        return glyph_masks[(uint8_t)letter].data();
+    }
+};
+
+// Pixels are stored as 8 bit RGBA, the layout sf::Image and the encoders take directly
+#define PIXEL_CHANNELS 4
+// Largest image a Drawable2D allocates, 1 GiB of RGBA pixels
+#define DRAWABLE_MAX_PIXELS ((size_t)1 << 28)
+
 class Drawable2D{
 public:
-    Color **color_array;
+    uint8_t *pixels;
     Color default_color;
-    sf::Font *font;
-    sf::Texture texture;
-    sf::Sprite sprite;
-    sf::RenderTexture rendertexture;
+    GlyphAtlas *glyph_atlas;
     
     int width, height;
 
-    Drawable2D(int width, int height, sf::Font *font = NULL, Color *default_color = NULL): width(width), height(height), font(font){
-        // Allocate our color array
-        color_array = (Color**) calloc(width * height, sizeof(Color));
-        // Fill the color array with default color
-        for(int color_index = 0; color_index < width * height; color_index++){
-            if(default_color){
-                color_array[color_index] = new Color(default_color->r, default_color->g, default_color->b);
-            }else{
-                color_array[color_index] = new Color();
-            }
-            
+    /**
+     * @brief Allocate the pixels and fill them with the default colour
+     *
+     * @throws std::length_error The size is negative or over DRAWABLE_MAX_PIXELS
+     * @throws std::bad_alloc The pixels couldn't be allocated
+     */
+    Drawable2D(int64_t width, int64_t height, GlyphAtlas *glyph_atlas = NULL, Color *default_color = NULL): pixels(NULL), glyph_atlas(glyph_atlas), width(0), height(0){
+        if(!is_valid_size(width, height)){
+            throw std::length_error("A " + std::to_string(width) + "x" + std::to_string(height) + " image is too large to draw");
         }
+        this->width = width;
+        this->height = height;
+
         // Store our default color
         if(default_color){
-            this->default_color.r = default_color->r;
-            this->default_color.g = default_color->g;
-            this->default_color.b = default_color->b;
-        }  
-        
-        texture.create(width, height);
+            this->default_color.set_color_from_color(*default_color);
+        }
 
-        rendertexture.create(width, height);
+        // Allocate our pixel buffer and fill it with the default color
+        pixels = (uint8_t*) malloc(get_pixel_count() * PIXEL_CHANNELS);
+        if(!pixels && get_pixel_count() > 0) throw std::bad_alloc();
+        fill(this->default_color);
+    } 
 
-        sprite.setTexture(texture);
+    virtual ~Drawable2D(){
+        free(pixels);
+    }
 
-    } 
+    // The pixels are owned, copying would free them twice
+    Drawable2D(const Drawable2D&) = delete;
+    Drawable2D& operator=(const Drawable2D&) = delete;
+
+    /**
+     * @brief Whether an image of this size can be allocated, sizes are 64 bit so a product that
+     * overflowed an int can be checked before it is narrowed
+     */
+    static bool is_valid_size(int64_t width, int64_t height){
+        if(width < 0 || height < 0 || width > INT_MAX || height > INT_MAX) return false;
+        return height == 0 || (uint64_t)width <= DRAWABLE_MAX_PIXELS / height;
+    }
+
+    size_t get_pixel_count(){
+        return (size_t)width * height;
+    }
+
+    size_t get_row_stride(){
+        return (size_t)width * PIXEL_CHANNELS;
+    }
+
+    uint8_t* get_pixel(int x, int y){
+        return pixels + (get_array_index(x, y) * PIXEL_CHANNELS);
+    }
+
+    static void write_pixel(uint8_t *pixel, Color color){
+        pixel[0] = color.r;
+        pixel[1] = color.g;
+        pixel[2] = color.b;
+        pixel[3] = 255;
+    }
+
+    static uint32_t pack_color(Color color){
+        return PixelKernels::pack_pixel(color.r, color.g, color.b);
+    }
+
+    void fill_row(int x, int y, int run_length, Color color){
+        if(run_length < 1) return;
+
+        PixelKernels::fill_pixels(get_pixel(x, y), pack_color(color), run_length);
+    }
 
     void fill(Color color){
-        for(int color_index = 0; color_index < width * height; color_index++){
-            color_array[color_index]->set_color_from_color(color);
-        }
+        if(width < 1 || height < 1) return;
+
+        // Rows follow each other with no padding, so the whole buffer is one run
+        PixelKernels::fill_pixels(pixels, pack_color(color), get_pixel_count());
     }
 
     bool valid_pixel(int x, int y){
@@ -95,111 +213,182 @@ public:
         return true;
     }
 
-    int get_array_index(int x, int y){
-        return (y * width) + x;
+    size_t get_array_index(int x, int y){
+        return ((size_t)y * width) + x;
     }
 
     void draw_edge(GridDirection direction, Color color){
-        int delta_x = 0, delta_y = 0, start_x = 0, start_y = 0, current_x, current_y;
-
-        if(direction == North) {
-            delta_x = 1;
-        }
-        if(direction == South){
-            delta_x = 1;
-            start_y = height - 1;
-        } 
-        if(direction == East){
-            delta_y = 1;
-            start_x = width - 1;
-        }
-        if(direction == West){
-            delta_y = 1;
-        }
-
-        current_x = start_x;
-        current_y = start_y;
+        if(width < 1 || height < 1) return;
 
-        while (valid_pixel(current_x, current_y)){
-            color_array[get_array_index(current_x, current_y)]->set_color_from_color(color);
+        if(direction == North) fill_row(0, 0, width, color);
+        if(direction == South) fill_row(0, height - 1, width, color);
 
-            current_x += delta_x;
-            current_y += delta_y;
+        if(direction == East || direction == West){
+            int column = direction == East ? width - 1 : 0;
+            PixelKernels::fill_column(get_pixel(column, 0), get_row_stride(), pack_color(color), height);
         }
     }
 
+#ifndef SPELLING_MAZE_SOFTWARE_RENDERER
     sf::Image to_sfml_image(){
-        int channel_count = 3;
         sf::Image image;
-        image.create(width, height);
+        image.create(width, height, pixels);
+
+        return image;
+    }
+#endif
+
+    /**
+     * @brief Blend a letter from the glyph atlas over the pixels
+     *
+     * @throws std::logic_error There is no glyph atlas, or it is for another size
+     */
+    void apply_letter_to_drawable(char letter, Color text_color = COLOR_BLACK){
+        if(!glyph_atlas || glyph_atlas->width != width || glyph_atlas->height != height){
+            throw std::logic_error("No glyph atlas for " + std::to_string(width) + "x" + std::to_string(height) + " blocks");
+        }
+
+        MAZE_COUNTER_TIMER(LetterNanoseconds);
+        MAZE_COUNT(LettersApplied, 1);
+        uint8_t *glyph = glyph_atlas->get_glyph(letter);
+        uint8_t text_channels[3] = {(uint8_t)text_color.r, (uint8_t)text_color.g, (uint8_t)text_color.b};
+
+        // Alpha blend the cached glyph over our pixels
+        for(size_t pixel_index = 0; pixel_index < get_pixel_count(); pixel_index++){
+            int alpha = glyph[pixel_index];
+            if(alpha == 0) continue;
 
-        for(int y = 0; y < height; y++){
-            for(int x = 0; x < width; x++){
-                image.setPixel(x, y, sf::Color(color_array[(y * width) + x]->r, color_array[(y * width) + x]->g, color_array[(y * width) + x]->b));
+            uint8_t *pixel = pixels + (pixel_index * PIXEL_CHANNELS);
+            for(int channel = 0; channel < 3; channel++){
+                pixel[channel] = ((pixel[channel] * (255 - alpha)) + (text_channels[channel] * alpha) + 127) / 255;
             }
         }
+    }
 
-        return image;
+    bool save_array_as_png(std::string filename, PngWriter::ImageOptions options = PngWriter::ImageOptions()){
+        MAZE_PHASE("save_png");
+        return PngWriter::save_png(filename, pixels, width, height, options);
     }
 
-    void apply_letter_to_drawable(char letter){
-        // Get our texture
-        texture.update(to_sfml_image());
+    std::vector<uint8_t> encode_array_as_png(PngWriter::ImageOptions options = PngWriter::ImageOptions()){
+        MAZE_PHASE("encode_png");
+        return PngWriter::encode_png(pixels, width, height, options);
+    }
 
-        // Create our text
-        sf::Text text(letter, *font);
-        text.setCharacterSize(height);
-        text.setColor(sf::Color::Black);
-        text.setPosition(sf::Vector2f(width / 4, -height / 4));
+    void draw_portion(int start_x, int start_y, int input_width, int input_height, const uint8_t *input_pixels){
+        // Clip the portion against our bounds once, then copy whole rows
+        int first_x = std::max(start_x, 0), first_y = std::max(start_y, 0);
+        int last_x = std::min(start_x + input_width, width), last_y = std::min(start_y + input_height, height);
 
-        // Put it in a render texture
-        rendertexture.draw(sprite);
-        rendertexture.draw(text);
-        rendertexture.display();
+        if(first_x >= last_x || first_y >= last_y) return;
 
+        int row_bytes = (last_x - first_x) * PIXEL_CHANNELS;
 
-        // Get the final image 
-        sf::Image final_image = rendertexture.getTexture().copyToImage();
+        for(int curr_y = first_y; curr_y < last_y; curr_y++){
+            const uint8_t *input_row = input_pixels + ((((curr_y - start_y) * input_width) + (first_x - start_x)) * PIXEL_CHANNELS);
+            memcpy(get_pixel(first_x, curr_y), input_row, row_bytes);
+        }
 
-        for(int y = 0; y < height; y++){
-            for(int x = 0; x < width; x++){
-                sf::Color color = final_image.getPixel(x, y);
+    }
 
-                color_array[(y * width) + x]->r = color.r;
-                color_array[(y * width) + x]->g = color.g;
-                color_array[(y * width) + x]->b = color.b;
-            }
-        }
-        
+    virtual uint8_t* draw(){
+        return pixels;
     }
+};
 
-    void save_array_as_png(std::string filename){
-        sf::Image image = to_sfml_image();
+/**
+ * @brief Every way a block can be drawn at one size in one pair of colours, drawn the first time
+ * it is asked for and copied in after that. A block is one of 16 wall masks on an explored or
+ * unexplored fill, lettered blocks are kept per letter on top of those. Tiles never change once
+ * drawn, so one set is shared by every map drawing that way, see FontCache::get_block_tiles.
+ */
+struct BlockTiles{
+    const int width, height;
+    const Color wall_color, background_color;
+private:
+    // Held so the letters can still be drawn after a font change, until every map using these is gone
+    std::shared_ptr<GlyphAtlas> glyph_atlas;
+    // Unlettered tiles one after another by wall mask and explored, with whether each is drawn yet.
+    // A drawn tile is read without locking, the flag is only set once its pixels are in place.
+    mutable std::vector<uint8_t> plain_tiles;
+    mutable std::atomic<bool> plain_ready[2 * (ALL_DIRECTIONS_MASK + 1)];
+    // Lettered tiles by letter, wall mask and explored, each published the same way once drawn.
+    // The pixels are owned by lettered_storage, which is only touched with the mutex held.
+    mutable std::atomic<const uint8_t*> lettered_tiles[(UCHAR_MAX + 1) * 2 * (ALL_DIRECTIONS_MASK + 1)];
+    mutable std::vector<std::unique_ptr<uint8_t[]>> lettered_storage;
+    mutable Drawable2D canvas;
+    mutable std::mutex mutex;
+
+    void draw_plain_tile(int tile_index, uint8_t wall_mask, bool explored) const{
+        std::lock_guard<std::mutex> lock(mutex);
+        if(plain_ready[tile_index].load(std::memory_order_relaxed)) return;
+
+        MAZE_COUNT(TilesBuilt, 1);
+        canvas.fill(explored ? background_color : COLOR_BLACK);
+        for(int direction = 0; direction < None; direction++){
+            if(!(wall_mask & direction_bit(GridDirection(direction)))) continue;
+            canvas.draw_edge(GridDirection(direction), wall_color);
+        }
 
-        image.saveToFile(filename);
+        memcpy(plain_tiles.data() + tile_index * get_tile_size(), canvas.pixels, get_tile_size());
+        plain_ready[tile_index].store(true, std::memory_order_release);
     }
 
-    void draw_portion(int start_x, int start_y, int input_width, int input_height, Color **input_array){
-        int curr_x, curr_y;
+    const uint8_t* draw_lettered_tile(int lettered_index, const uint8_t *plain_tile, char letter) const{
+        std::lock_guard<std::mutex> lock(mutex);
+        const uint8_t *lettered_tile = lettered_tiles[lettered_index].load(std::memory_order_relaxed);
+        if(lettered_tile) return lettered_tile;
 
-        for(int y = 0; y < input_height; y++){
-            for(int x = 0; x < input_width; x++){
-                int array_index;
+        MAZE_COUNT(TilesBuilt, 1);
+        memcpy(canvas.pixels, plain_tile, get_tile_size());
+        canvas.apply_letter_to_drawable(letter);
 
-                curr_x = start_x + x;
-                curr_y = start_y + y;
-                array_index = get_array_index(curr_x, curr_y);
+        lettered_storage.emplace_back(new uint8_t[get_tile_size()]);
+        memcpy(lettered_storage.back().get(), canvas.pixels, get_tile_size());
+        lettered_tiles[lettered_index].store(lettered_storage.back().get(), std::memory_order_release);
+        return lettered_storage.back().get();
+    }
+public:
+    /**
+     * @param glyph_atlas Atlas to draw letters from, NULL for tiles that are never lettered
+     */
+    BlockTiles(int width, int height, Color wall_color = COLOR_BLACK, Color background_color = COLOR_WHITE, std::shared_ptr<GlyphAtlas> glyph_atlas = NULL): width(width), height(height), wall_color(wall_color), background_color(background_color), glyph_atlas(glyph_atlas), canvas(width, height, glyph_atlas.get()){
+        plain_tiles.resize(sizeof(plain_ready) / sizeof(plain_ready[0]) * get_tile_size());
+        for(std::atomic<bool> &ready: plain_ready) ready.store(false, std::memory_order_relaxed);
+        for(std::atomic<const uint8_t*> &lettered_tile: lettered_tiles) lettered_tile.store(NULL, std::memory_order_relaxed);
+    }
 
-                if(!valid_pixel(curr_x, curr_y)) continue;
-                color_array[array_index]->r = input_array[(y * input_width) + x]->r;
-                color_array[array_index]->g = input_array[(y * input_width) + x]->g;
-                color_array[array_index]->b = input_array[(y * input_width) + x]->b;
-            }
-        }
+    BlockTiles(const BlockTiles&) = delete;
+    BlockTiles& operator=(const BlockTiles&) = delete;
+
+    size_t get_tile_size() const{
+        return (size_t)width * height * PIXEL_CHANNELS;
+    }
 
+    bool has_letters() const{
+        return glyph_atlas != NULL;
     }
 
-    virtual Color** draw(){}
+    /**
+     * @brief Get the pixels of a block, drawing them if this is the first block drawn this way.
+     * Safe to call from any number of threads at once.
+     *
+     * @param wall_mask Sides of the block with a wall, as a direction mask
+     * @param explored Explored blocks are filled with the background colour, the rest with black
+     * @param letter Letter to write on the block, 0 for none
+     * @return const uint8_t* width * height RGBA pixels, valid as long as the tiles are
+     */
+    const uint8_t* get_tile(uint8_t wall_mask, bool explored, char letter = 0) const{
+        int tile_index = ((wall_mask & ALL_DIRECTIONS_MASK) << 1) | explored;
+        const uint8_t *plain_tile = plain_tiles.data() + tile_index * get_tile_size();
+
+        if(!plain_ready[tile_index].load(std::memory_order_acquire)) draw_plain_tile(tile_index, wall_mask, explored);
+        if(letter == 0) return plain_tile;
+
+        int lettered_index = (uint8_t)letter * 2 * (ALL_DIRECTIONS_MASK + 1) + tile_index;
+        const uint8_t *lettered_tile = lettered_tiles[lettered_index].load(std::memory_order_acquire);
+        return lettered_tile ? lettered_tile : draw_lettered_tile(lettered_index, plain_tile, letter);
+    }
 };
 
 
@@ -0,0 +1,191 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef SPELLING_MAZE_SOFTWARE_RENDERER
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#else
+#include <SFML/Graphics.hpp>
+#include <SFML/Window.hpp>
+#endif
+
+#ifndef FONT_H
+#define FONT_H
+
+namespace Drawable{
+/**
+ * @brief The font letters are rasterized from. The SFML backend draws through a render
+ * texture and needs a GL context, the software backend rasterizes with FreeType on the CPU.
+ * Rasterizing is serialized, so one font can be shared by every thread.
+ */
+struct Font{
+private:
+    // Both backends read a font loaded from memory lazily, so it has to outlive them
+    std::vector<uint8_t> font_data;
+    std::mutex rasterize_mutex;
+#ifdef SPELLING_MAZE_SOFTWARE_RENDERER
+    FT_Library library;
+    FT_Face face;
+    bool face_loaded;
+#else
+    sf::Font font;
+    sf::RenderTexture rendertexture;
+    int render_width, render_height;
+#endif
+public:
+#ifdef SPELLING_MAZE_SOFTWARE_RENDERER
+    Font(): library(NULL), face(NULL), face_loaded(false){
+        FT_Init_FreeType(&library);
+    }
+
+    ~Font(){
+        if(face_loaded) FT_Done_Face(face);
+        if(library) FT_Done_FreeType(library);
+    }
+#else
+    Font(): render_width(0), render_height(0){}
+#endif
+
+    Font(const Font&) = delete;
+    Font& operator=(const Font&) = delete;
+
+    /**
+     * @brief Load a font from a file, if it can't be loaded the font already loaded is kept
+     *
+     * @param filename The font file
+     * @return true The font loaded
+     */
+    bool load_from_file(std::string filename){
+#ifdef SPELLING_MAZE_SOFTWARE_RENDERER
+        FT_Face new_face;
+        if(!library || FT_New_Face(library, filename.c_str(), 0, &new_face) != 0) return false;
+
+        std::lock_guard<std::mutex> lock(rasterize_mutex);
+        if(face_loaded) FT_Done_Face(face);
+        face = new_face;
+        face_loaded = true;
+#else
+        sf::Font new_font;
+        if(!new_font.loadFromFile(filename)) return false;
+
+        std::lock_guard<std::mutex> lock(rasterize_mutex);
+        font = new_font;
+#endif
+        // Only the face that was replaced could still be reading it
+        std::vector<uint8_t>().swap(font_data);
+        return true;
+    }
+
+    /**
+     * @brief Load a font from a file already in memory, the data is copied. If it can't be
+     * loaded the font already loaded is kept, along with the data it reads from.
+     *
+     * @param data The font file
+     * @param size Size of the file in bytes
+     * @return true The font loaded
+     */
+    bool load_from_memory(const uint8_t *data, size_t size){
+        std::vector<uint8_t> new_data(data, data + size);
+
+#ifdef SPELLING_MAZE_SOFTWARE_RENDERER
+        FT_Face new_face;
+        if(!library || FT_New_Memory_Face(library, new_data.data(), new_data.size(), 0, &new_face) != 0) return false;
+
+        std::lock_guard<std::mutex> lock(rasterize_mutex);
+        if(face_loaded) FT_Done_Face(face);
+        face = new_face;
+        face_loaded = true;
+#else
+        sf::Font new_font;
+        if(!new_font.loadFromMemory(new_data.data(), new_data.size())) return false;
+
+        std::lock_guard<std::mutex> lock(rasterize_mutex);
+        font = new_font;
+#endif
+        // Swapping keeps the new face's buffer where it is, the old data is freed once the old face is gone
+        font_data.swap(new_data);
+        return true;
+    }
+
+    /**
+     * @brief Rasterize a letter the way it is placed on a block, at the block's height and
+     * shifted a quarter block right and up
+     *
+     * @param letter The letter
+     * @param width Block width
+     * @param height Block height
+     * @param mask width * height coverage values to write the letter into
+     */
+    void rasterize_letter(char letter, int width, int height, uint8_t *mask){
+        std::lock_guard<std::mutex> lock(rasterize_mutex);
+        memset(mask, 0, (size_t)width * height);
+
+#ifdef SPELLING_MAZE_SOFTWARE_RENDERER
+        if(!face_loaded) return;
+
+        // Same size and hinting SFML asks FreeType for, so both backends produce the same glyphs
+        FT_Set_Pixel_Sizes(face, 0, height);
+        if(FT_Load_Char(face, (uint8_t)letter, FT_LOAD_RENDER | FT_LOAD_FORCE_AUTOHINT | FT_LOAD_TARGET_NORMAL) != 0) return;
+
+        FT_Bitmap &bitmap = face->glyph->bitmap;
+
+        // sf::Text puts the baseline one character size below its position
+        int origin_x = (width / 4) + face->glyph->bitmap_left;
+        int origin_y = (-height / 4) + height - face->glyph->bitmap_top;
+
+        if(bitmap.pixel_mode != FT_PIXEL_MODE_GRAY && bitmap.pixel_mode != FT_PIXEL_MODE_MONO) return;
+
+        // Rows are pitch bytes apart including padding, a negative pitch means the bitmap is stored
+        // bottom up and the buffer starts at its last row
+        const uint8_t *top_row = bitmap.buffer;
+        if(bitmap.pitch < 0) top_row -= (ptrdiff_t)bitmap.pitch * ((int)bitmap.rows - 1);
+
+        for(int glyph_y = 0; glyph_y < (int)bitmap.rows; glyph_y++){
+            int y = origin_y + glyph_y;
+            if(y < 0 || y >= height) continue;
+
+            const uint8_t *glyph_row = top_row + (ptrdiff_t)glyph_y * bitmap.pitch;
+            for(int glyph_x = 0; glyph_x < (int)bitmap.width; glyph_x++){
+                int x = origin_x + glyph_x;
+                if(x < 0 || x >= width) continue;
+
+                // Fonts with embedded bitmaps can come back one bit per pixel
+                uint8_t coverage;
+                if(bitmap.pixel_mode == FT_PIXEL_MODE_MONO) coverage = (glyph_row[glyph_x / 8] >> (7 - (glyph_x % 8))) & 1 ? 255 : 0;
+                else coverage = glyph_row[glyph_x];
+
+                mask[((size_t)y * width) + x] = coverage;
+            }
+        }
+#else
+        if(render_width != width || render_height != height){
+            rendertexture.create(width, height);
+            render_width = width;
+            render_height = height;
+        }
+
+        // Draw the letter onto a transparent target, its alpha is the coverage
+        sf::Text text(letter, font);
+        text.setCharacterSize(height);
+        text.setFillColor(sf::Color::Black);
+        text.setPosition(sf::Vector2f(width / 4, -height / 4));
+
+        rendertexture.clear(sf::Color::Transparent);
+        rendertexture.draw(text);
+        rendertexture.display();
+
+        sf::Image glyph_image = rendertexture.getTexture().copyToImage();
+        const sf::Uint8 *glyph_pixels = glyph_image.getPixelsPtr();
+
+        for(int pixel_index = 0; pixel_index < width * height; pixel_index++){
+            mask[pixel_index] = glyph_pixels[(pixel_index * 4) + 3];
+        }
+#endif
+    }
+};
+}
+#endif
@@ -0,0 +1,143 @@
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include "drawable.hpp"
+#include "instrumentation.hpp"
+
+#ifdef SPELLING_MAZE_EMBEDDED_FONT
+#include "embedded_font.hpp"
+#endif
+
+#ifndef FONT_CACHE_H
+#define FONT_CACHE_H
+
+// Where the default font is read from when it isn't compiled in, CMake points this at the source tree
+#ifndef SPELLING_MAZE_FONT_PATH
+#define SPELLING_MAZE_FONT_PATH "../res/font.ttf"
+#endif
+
+namespace Drawable{
+/**
+ * @brief The font, glyph atlases and block tiles shared by every maze in the process. The font is
+ * loaded once, the first time a maze needs it, and each block size gets one atlas. Neither changes
+ * once built, so mazes keep hold of their atlas and draw from it without locking. Block tiles are
+ * kept per block size, colours and whether they're lettered, so a batch of mazes draws each tile once.
+ */
+struct FontCache{
+    // Block size, wall and background colour and whether the tiles are lettered
+    typedef std::tuple<int, int, uint32_t, uint32_t, bool> TilesKey;
+
+    std::mutex mutex;
+    std::shared_ptr<Font> font;
+    std::map<std::pair<int, int>, std::shared_ptr<GlyphAtlas>> glyph_atlases;
+    std::map<TilesKey, std::shared_ptr<const BlockTiles>> block_tiles;
+
+    /**
+     * @brief Load the font the module ships with, compiled in when SPELLING_MAZE_EMBEDDED_FONT
+     * is defined and read from SPELLING_MAZE_FONT_PATH otherwise
+     *
+     * @return std::shared_ptr<Font> The font, NULL if it couldn't be loaded
+     */
+    static std::shared_ptr<Font> load_default_font(){
+        MAZE_PHASE("load_font");
+        std::shared_ptr<Font> default_font(new Font());
+
+#ifdef SPELLING_MAZE_EMBEDDED_FONT
+        if(!default_font->load_from_memory(embedded_font_data, embedded_font_size)) return NULL;
+#else
+        if(!default_font->load_from_file(SPELLING_MAZE_FONT_PATH)) return NULL;
+#endif
+
+        return default_font;
+    }
+
+    /**
+     * @brief Use another font from now on, mazes already being drawn finish with the old one
+     */
+    void set_font(std::shared_ptr<Font> new_font){
+        std::lock_guard<std::mutex> lock(mutex);
+        font = new_font;
+        glyph_atlases.clear();
+        block_tiles.clear();
+    }
+
+    bool load_font_from_file(std::string filename){
+        std::shared_ptr<Font> new_font(new Font());
+
+        if(!new_font->load_from_file(filename)) return false;
+
+        set_font(new_font);
+        return true;
+    }
+
+    bool load_font_from_memory(const uint8_t *data, size_t size){
+        std::shared_ptr<Font> new_font(new Font());
+
+        if(!new_font->load_from_memory(data, size)) return false;
+
+        set_font(new_font);
+        return true;
+    }
+
+    /**
+     * @brief Get the atlas for a block size, rasterizing it the first time the size is asked for
+     *
+     * @param width Block width
+     * @param height Block height
+     * @return std::shared_ptr<GlyphAtlas> The atlas, NULL if no font could be loaded
+     */
+    std::shared_ptr<GlyphAtlas> get_glyph_atlas(int width, int height){
+        std::lock_guard<std::mutex> lock(mutex);
+        return get_glyph_atlas_locked(width, height);
+    }
+
+    /**
+     * @brief Get the tiles every map drawing blocks this way shares
+     *
+     * @param lettered Whether letters will be drawn, which needs the font loaded
+     * @return std::shared_ptr<const BlockTiles> The tiles, NULL if they're lettered and no font could be loaded
+     */
+    std::shared_ptr<const BlockTiles> get_block_tiles(int width, int height, Color wall_color, Color background_color, bool lettered){
+        std::lock_guard<std::mutex> lock(mutex);
+        TilesKey key(width, height, PixelKernels::pack_pixel(wall_color.r, wall_color.g, wall_color.b), PixelKernels::pack_pixel(background_color.r, background_color.g, background_color.b), lettered);
+
+        std::shared_ptr<const BlockTiles> &tiles = block_tiles[key];
+        if(!tiles){
+            std::shared_ptr<GlyphAtlas> glyph_atlas;
+            if(lettered){
+                glyph_atlas = get_glyph_atlas_locked(width, height);
+                if(!glyph_atlas){
+                    block_tiles.erase(key);
+                    return NULL;
+                }
+            }
+            tiles.reset(new BlockTiles(width, height, wall_color, background_color, glyph_atlas));
+        }
+
+        return tiles;
+    }
+private:
+    std::shared_ptr<GlyphAtlas> get_glyph_atlas_locked(int width, int height){
+        if(!font){
+            font = load_default_font();
+            if(!font) return NULL;
+        }
+
+        std::shared_ptr<GlyphAtlas> &glyph_atlas = glyph_atlases[std::pair<int, int>(width, height)];
+        if(!glyph_atlas) glyph_atlas.reset(new GlyphAtlas(font, width, height));
+
+        return glyph_atlas;
+    }
+};
+
+FontCache& get_font_cache(){
+    static FontCache font_cache;
+    return font_cache;
+}
+}
+
+#endif
@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include "utils.hpp"
+#include "cancellation.hpp"
+
+#ifndef GENERATORS_H
+#define GENERATORS_H
+
+// Cell states of a CarveRegion
+#define REGION_EXCLUDED 0
+#define REGION_CARVABLE 1
+#define REGION_ROOT 2
+
+/**
+ * @brief The part of a grid a generator may carve. Roots are already in the maze and may have
+ * passages opened from them, carvable cells are joined to the roots, excluded cells are left alone.
+ */
+struct CarveRegion{
+    int grid_width, grid_height;
+    std::vector<uint8_t> cell_states;
+
+    CarveRegion(int grid_width, int grid_height): grid_width(grid_width), grid_height(grid_height), cell_states(grid_width * grid_height, REGION_EXCLUDED){}
+
+    int get_cell_count(){
+        return grid_width * grid_height;
+    }
+
+    /**
+     * @brief Get the cell next to another one
+     *
+     * @param cell_index The cell
+     * @param direction Direction to look in
+     * @return int Index of the neighbour, -1 if it is off the grid
+     */
+    int get_neighbour(int cell_index, GridDirection direction){
+        int x = cell_index % grid_width, y = cell_index / grid_width;
+
+        if(direction == North) y -= 1;
+        if(direction == South) y += 1;
+        if(direction == West) x -= 1;
+        if(direction == East) x += 1;
+
+        if(direction == None || x < 0 || y < 0 || x >= grid_width || y >= grid_height) return -1;
+
+        return (y * grid_width) + x;
+    }
+
+    /**
+     * @brief Get the direction from a cell to one of its neighbours
+     */
+    GridDirection get_direction(int cell_index, int neighbour_index){
+        int offset = neighbour_index - cell_index;
+
+        if(offset == -grid_width) return North;
+        if(offset == grid_width) return South;
+        if(offset == -1) return West;
+        if(offset == 1) return East;
+        return None;
+    }
+
+    /**
+     * @brief Exclude every carvable cell that no root can reach through other carvable cells,
+     * so generators never wait on a pocket they can't connect
+     */
+    void exclude_unreachable_cells(){
+        std::vector<bool> reached(get_cell_count(), false);
+        std::vector<int> search_queue;
+
+        for(int cell_index = 0; cell_index < get_cell_count(); cell_index++){
+            if(cell_states[cell_index] != REGION_ROOT) continue;
+
+            reached[cell_index] = true;
+            search_queue.push_back(cell_index);
+        }
+
+        for(size_t queue_head = 0; queue_head < search_queue.size(); queue_head++){
+            for(int direction = 0; direction < None; direction++){
+                int neighbour = get_neighbour(search_queue[queue_head], GridDirection(direction));
+
+                if(neighbour == -1 || reached[neighbour] || cell_states[neighbour] != REGION_CARVABLE) continue;
+
+                reached[neighbour] = true;
+                search_queue.push_back(neighbour);
+            }
+        }
+
+        for(int cell_index = 0; cell_index < get_cell_count(); cell_index++){
+            if(cell_states[cell_index] == REGION_CARVABLE && !reached[cell_index]) cell_states[cell_index] = REGION_EXCLUDED;
+        }
+    }
+};
+
+/**
+ * @brief A passage opened between two neighbouring cells
+ */
+typedef std::pair<int, int> Passage;
+
+/**
+ * @brief Builds a spanning tree over a region. Every carvable cell ends up connected to exactly
+ * one root through the returned passages, and no passage ever joins two roots.
+ */
+struct MazeGenerator{
+    virtual ~MazeGenerator(){}
+
+    virtual std::string get_name() = 0;
+
+    /**
+     * @brief Carve the region
+     *
+     * @param region The region, unreachable cells must already be excluded
+     * @param random Random context to draw from
+     * @param passages Where to append the opened passages
+     */
+    virtual void carve(CarveRegion &region, RandomContext &random, std::vector<Passage> &passages) = 0;
+
+    /**
+     * @brief Get the neighbours of a cell that are still carvable and not yet in the tree
+     */
+    static int get_open_neighbours(CarveRegion &region, std::vector<bool> &in_tree, int cell_index, int *neighbours){
+        int neighbour_count = 0;
+
+        for(int direction = 0; direction < None; direction++){
+            int neighbour = region.get_neighbour(cell_index, GridDirection(direction));
+
+            if(neighbour == -1 || in_tree[neighbour] || region.cell_states[neighbour] != REGION_CARVABLE) continue;
+
+            neighbours[neighbour_count++] = neighbour;
+        }
+
+        return neighbour_count;
+    }
+
+    static std::vector<bool> get_roots(CarveRegion &region, std::vector<int> &roots){
+        std::vector<bool> in_tree(region.get_cell_count(), false);
+
+        for(int cell_index = 0; cell_index < region.get_cell_count(); cell_index++){
+            if(region.cell_states[cell_index] != REGION_ROOT) continue;
+
+            in_tree[cell_index] = true;
+            roots.push_back(cell_index);
+        }
+
+        return in_tree;
+    }
+};
+
+/**
+ * @brief Growing tree, keeps a list of active cells and grows from the newest or a random one.
+ * Always newest gives long corridors, always random gives short branchy passages.
+ */
+struct GrowingTreeGenerator: public MazeGenerator{
+    float newest_chance;
+
+    GrowingTreeGenerator(float newest_chance = 0.5): newest_chance(newest_chance){}
+
+    std::string get_name(){
+        return "growing_tree";
+    }
+
+    void carve(CarveRegion &region, RandomContext &random, std::vector<Passage> &passages){
+        std::vector<int> active_cells;
+        std::vector<bool> in_tree = get_roots(region, active_cells);
+        int neighbours[4];
+
+        while(!active_cells.empty()){
+            int active_index = active_cells.size() - 1;
+            if(!random.get_rand_bool(newest_chance)) active_index = random.get_rand_int(0, active_cells.size() - 1);
+
+            int cell_index = active_cells[active_index];
+            int neighbour_count = get_open_neighbours(region, in_tree, cell_index, neighbours);
+
+            if(neighbour_count == 0){
+                // Order doesn't matter apart from the newest cell, so swap remove
+                active_cells[active_index] = active_cells.back();
+                active_cells.pop_back();
+                continue;
+            }
+
+            int next_cell = neighbours[random.get_rand_int(0, neighbour_count - 1)];
+            in_tree[next_cell] = true;
+            passages.push_back(Passage(cell_index, next_cell));
+            active_cells.push_back(next_cell);
+            if(Cancellation::is_cancelled(passages.size())) return;
+        }
+    }
+};
+
+/**
+ * @brief Iterative recursive backtracker, a depth first walk that backs up at dead ends
+ */
+struct BacktrackerGenerator: public MazeGenerator{
+    std::string get_name(){
+        return "backtracker";
+    }
+
+    void carve(CarveRegion &region, RandomContext &random, std::vector<Passage> &passages){
+        std::vector<int> roots, cell_stack;
+        std::vector<bool> in_tree = get_roots(region, roots);
+        int neighbours[4];
+
+        // Start from the roots in a random order so no root is always grown first
+        for(int root_index = roots.size() - 1; root_index > 0; root_index--){
+            std::swap(roots[root_index], roots[random.get_rand_int(0, root_index)]);
+        }
+        cell_stack = roots;
+
+        while(!cell_stack.empty()){
+            int cell_index = cell_stack.back();
+            int neighbour_count = get_open_neighbours(region, in_tree, cell_index, neighbours);
+
+            if(neighbour_count == 0){
+                cell_stack.pop_back();
+                continue;
+            }
+
+            int next_cell = neighbours[random.get_rand_int(0, neighbour_count - 1)];
+            in_tree[next_cell] = true;
+            passages.push_back(Passage(cell_index, next_cell));
+            cell_stack.push_back(next_cell);
+            if(Cancellation::is_cancelled(passages.size())) return;
+        }
+    }
+};
+
+/**
+ * @brief Wilson's algorithm, loop erased random walks from every cell until they hit the tree.
+ * Gives a uniformly random spanning tree, at the cost of long walks while the tree is small.
+ */
+struct WilsonGenerator: public MazeGenerator{
+    std::string get_name(){
+        return "wilson";
+    }
+
+    void carve(CarveRegion &region, RandomContext &random, std::vector<Passage> &passages){
+        std::vector<int> roots, walk_order;
+        std::vector<bool> in_tree = get_roots(region, roots);
+        // The direction each cell last left in, overwriting it is what erases loops
+        std::vector<uint8_t> walk_direction(region.get_cell_count(), None);
+        int neighbours[4];
+
+        if(roots.empty()) return;
+
+        for(int cell_index = 0; cell_index < region.get_cell_count(); cell_index++){
+            if(region.cell_states[cell_index] == REGION_CARVABLE) walk_order.push_back(cell_index);
+        }
+        for(int order_index = walk_order.size() - 1; order_index > 0; order_index--){
+            std::swap(walk_order[order_index], walk_order[random.get_rand_int(0, order_index)]);
+        }
+
+        size_t walk_steps = 0;
+        for(int walk_start: walk_order){
+            if(in_tree[walk_start]) continue;
+
+            int cell_index = walk_start;
+            while(!in_tree[cell_index]){
+                // Early walks wander for a long time, so poll inside them too
+                if(Cancellation::is_cancelled(++walk_steps)) return;
+                int neighbour_count = 0;
+                GridDirection directions[4];
+
+                for(int direction = 0; direction < None; direction++){
+                    int neighbour = region.get_neighbour(cell_index, GridDirection(direction));
+                    if(neighbour == -1 || region.cell_states[neighbour] == REGION_EXCLUDED) continue;
+
+                    directions[neighbour_count] = GridDirection(direction);
+                    neighbours[neighbour_count++] = neighbour;
+                }
+
+                int choice = random.get_rand_int(0, neighbour_count - 1);
+                walk_direction[cell_index] = directions[choice];
+                cell_index = neighbours[choice];
+            }
+
+            // Retrace the loop erased walk into the tree
+            cell_index = walk_start;
+            while(!in_tree[cell_index]){
+                int next_cell = region.get_neighbour(cell_index, GridDirection(walk_direction[cell_index]));
+
+                in_tree[cell_index] = true;
+                passages.push_back(Passage(next_cell, cell_index));
+                cell_index = next_cell;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Randomized Kruskal, opens walls in a random order whenever they join two separate sets
+ */
+struct KruskalGenerator: public MazeGenerator{
+private:
+    std::vector<int> set_parents;
+
+    int find_set(int cell_index){
+        while(set_parents[cell_index] != cell_index){
+            set_parents[cell_index] = set_parents[set_parents[cell_index]];
+            cell_index = set_parents[cell_index];
+        }
+        return cell_index;
+    }
+public:
+    std::string get_name(){
+        return "kruskal";
+    }
+
+    void carve(CarveRegion &region, RandomContext &random, std::vector<Passage> &passages){
+        std::vector<Passage> walls;
+        int root_set = -1;
+
+        set_parents.resize(region.get_cell_count());
+        for(int cell_index = 0; cell_index < region.get_cell_count(); cell_index++){
+            set_parents[cell_index] = cell_index;
+
+            // Every root starts in one shared set, so no passage ever joins two roots
+            if(region.cell_states[cell_index] == REGION_ROOT){
+                if(root_set == -1) root_set = cell_index;
+                set_parents[cell_index] = root_set;
+            }
+        }
+
+        // Only the east and south walls of each cell, so every wall is listed once
+        for(int cell_index = 0; cell_index < region.get_cell_count(); cell_index++){
+            if(Cancellation::is_cancelled(cell_index)) return;
+            if(region.cell_states[cell_index] == REGION_EXCLUDED) continue;
+
+            for(GridDirection direction: {East, South}){
+                int neighbour = region.get_neighbour(cell_index, direction);
+                if(neighbour == -1 || region.cell_states[neighbour] == REGION_EXCLUDED) continue;
+                if(region.cell_states[cell_index] == REGION_ROOT && region.cell_states[neighbour] == REGION_ROOT) continue;
+
+                walls.push_back(Passage(cell_index, neighbour));
+            }
+        }
+
+        for(int wall_index = walls.size() - 1; wall_index > 0; wall_index--){
+            if(Cancellation::is_cancelled(wall_index)) return;
+            std::swap(walls[wall_index], walls[random.get_rand_int(0, wall_index)]);
+        }
+
+        for(size_t wall_index = 0; wall_index < walls.size(); wall_index++){
+            Passage &wall = walls[wall_index];
+            if(Cancellation::is_cancelled(wall_index + 1)) return;
+
+            int first_set = find_set(wall.first), second_set = find_set(wall.second);
+            if(first_set == second_set) continue;
+
+            // Keep the root set as the representative so it is never merged away
+            if(second_set == root_set){
+                set_parents[first_set] = second_set;
+            }else{
+                set_parents[second_set] = first_set;
+            }
+            passages.push_back(wall);
+        }
+    }
+};
+
+/**
+ * @brief Eller's algorithm, builds a perfect maze one row at a time while only remembering which
+ * set each cell of the current row belongs to, so memory grows with the width and not the area
+ */
+struct EllerRowGenerator{
+private:
+    int grid_width;
+    // Set of each cell in the current row, set ids are recycled so they always stay below grid_width
+    std::vector<int> row_sets;
+    // Union find over set ids while the row's horizontal passages are joined
+    std::vector<int> set_parents;
+    std::vector<int> set_sizes, set_chosen_cell;
+    std::vector<bool> set_in_use, set_goes_down, opens_down;
+
+    int find_set(int set_id){
+        while(set_parents[set_id] != set_id){
+            set_parents[set_id] = set_parents[set_parents[set_id]];
+            set_id = set_parents[set_id];
+        }
+        return set_id;
+    }
+public:
+    // The open sides of each cell in the last generated row, as GridDirection bits
+    std::vector<uint8_t> open_masks;
+
+    EllerRowGenerator(int grid_width): grid_width(grid_width), row_sets(grid_width, -1), set_parents(grid_width), set_sizes(grid_width), set_chosen_cell(grid_width), set_in_use(grid_width), set_goes_down(grid_width), opens_down(grid_width, false), open_masks(grid_width, 0){}
+
+    /**
+     * @brief Generate the next row into open_masks
+     *
+     * @param random Random context to draw from
+     * @param last_row Join every remaining set, closing the maze off
+     * @param join_chance Chance of joining two neighbouring cells from different sets
+     */
+    void next_row(RandomContext &random, bool last_row = false, float join_chance = 0.5){
+        // Cells the row above opened into keep its set, the rest start a set of their own
+        std::fill(set_in_use.begin(), set_in_use.end(), false);
+        for(int x = 0; x < grid_width; x++){
+            if(!opens_down[x]) row_sets[x] = -1;
+            if(row_sets[x] != -1) set_in_use[row_sets[x]] = true;
+        }
+
+        int next_free_set = 0;
+        for(int x = 0; x < grid_width; x++){
+            open_masks[x] = opens_down[x] ? direction_bit(North) : 0;
+            if(row_sets[x] != -1) continue;
+
+            while(set_in_use[next_free_set]) next_free_set++;
+            row_sets[x] = next_free_set;
+            set_in_use[next_free_set] = true;
+        }
+
+        for(int set_id = 0; set_id < grid_width; set_id++){
+            set_parents[set_id] = set_id;
+        }
+
+        for(int x = 0; x < grid_width - 1; x++){
+            int left_set = find_set(row_sets[x]), right_set = find_set(row_sets[x + 1]);
+            if(left_set == right_set || !(last_row || random.get_rand_bool(join_chance))) continue;
+
+            set_parents[right_set] = left_set;
+            open_masks[x] |= direction_bit(East);
+            open_masks[x + 1] |= direction_bit(West);
+        }
+
+        for(int x = 0; x < grid_width; x++){
+            row_sets[x] = find_set(row_sets[x]);
+            opens_down[x] = false;
+        }
+
+        if(last_row) return;
+
+        // Every set has to carry on into the next row at least once, or it would be cut off.
+        // Reservoir sampling picks the cell a set is forced down from in the same pass.
+        std::fill(set_sizes.begin(), set_sizes.end(), 0);
+        std::fill(set_goes_down.begin(), set_goes_down.end(), false);
+        for(int x = 0; x < grid_width; x++){
+            int set_id = row_sets[x];
+
+            set_sizes[set_id]++;
+            if(random.get_rand_int(0, set_sizes[set_id] - 1) == 0) set_chosen_cell[set_id] = x;
+
+            opens_down[x] = random.get_rand_bool(0.5);
+            if(opens_down[x]) set_goes_down[set_id] = true;
+        }
+
+        for(int x = 0; x < grid_width; x++){
+            int set_id = row_sets[x];
+            if(!set_goes_down[set_id] && set_chosen_cell[set_id] == x) opens_down[x] = true;
+        }
+
+        for(int x = 0; x < grid_width; x++){
+            if(opens_down[x]) open_masks[x] |= direction_bit(South);
+        }
+    }
+};
+
+enum GeneratorType{
+    GrowingTree = 0,
+    Backtracker = 1,
+    Wilson = 2,
+    Kruskal = 3
+};
+
+MazeGenerator* create_generator(GeneratorType type){
+    if(type == Backtracker) return new BacktrackerGenerator();
+    if(type == Wilson) return new WilsonGenerator();
+    if(type == Kruskal) return new KruskalGenerator();
+    return new GrowingTreeGenerator();
+}
+
+/**
+ * @brief Look a generator up by the name it reports
+ *
+ * @param name The generator name, such as "kruskal"
+ * @param type Set to the matching type
+ * @return true The name was found
+ * @return false There is no generator with that name
+ */
+bool get_generator_type(std::string name, GeneratorType &type){
+    for(int type_index = GrowingTree; type_index <= Kruskal; type_index++){
+        std::unique_ptr<MazeGenerator> generator(create_generator(GeneratorType(type_index)));
+        if(generator->get_name() == name){
+            type = GeneratorType(type_index);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
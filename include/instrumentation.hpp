@@ -0,0 +1,226 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+namespace Instrumentation{
+enum Counter{
+    // Calls to Maze::carve_from_roots, one for generation and one per word fill out
+    CarvePasses = 0,
+    // Passages opened by the generator across every carve
+    CarvedPassages,
+    // Blocks fill out grew new branches from
+    FillOutRoots,
+    // Junctions select_solution_path_junctions drew that were already chosen
+    JunctionRetries,
+    // Branches moved onto the solution path, detours and shortcuts taken by it and moves of its end, to make room for a word
+    ReparentedBlocks,
+    PathDetours,
+    PathShortcuts,
+    PathEndMoves,
+    // Mazes rebuilt around a comb path because reshaping couldn't fit the word, or couldn't leave every area reachable
+    CombPaths,
+    // Word mazes started from a skeleton the pool had ready instead of being generated
+    PooledSkeletons,
+    BlocksDrawn,
+    // Block tiles drawn for the first time in the process, every other block drawn is a copy of one of them
+    TilesBuilt,
+    LettersApplied,
+    // Time spent blending letters, too many of them to record each one as a phase
+    LetterNanoseconds,
+    COUNTER_COUNT
+};
+
+static const char *counter_names[COUNTER_COUNT] = {
+    "carve_passes", "carved_passages", "fill_out_roots", "junction_retries", "reparented_blocks", "path_detours", "path_shortcuts", "path_end_moves", "comb_paths",
+    "pooled_skeletons", "blocks_drawn", "tiles_built", "letters_applied", "letter_ns"
+};
+
+int64_t get_time_ns(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief One timed phase, in steady clock nanoseconds
+ */
+struct PhaseEvent{
+    const char *name;
+    int64_t start_ns, duration_ns;
+    int thread_index;
+
+    PhaseEvent(const char *name, int64_t start_ns, int64_t duration_ns, int thread_index): name(name), start_ns(start_ns), duration_ns(duration_ns), thread_index(thread_index){}
+};
+
+/**
+ * @brief Everything recorded while a stats collector was active. This is always available so
+ * callers don't need to care how the library was built, it just stays empty when
+ * SPELLING_MAZE_INSTRUMENTATION isn't defined.
+ */
+struct MazeStats{
+    int64_t counters[COUNTER_COUNT];
+    std::vector<PhaseEvent> phases;
+
+    MazeStats(){
+        clear();
+    }
+
+    static bool is_enabled(){
+#ifdef SPELLING_MAZE_INSTRUMENTATION
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void clear(){
+        for(int counter = 0; counter < COUNTER_COUNT; counter++) counters[counter] = 0;
+        phases.clear();
+    }
+
+    /**
+     * @brief Add another collector's results to this one, used to gather a batch from its threads
+     */
+    void merge(MazeStats &other){
+        for(int counter = 0; counter < COUNTER_COUNT; counter++) counters[counter] += other.counters[counter];
+        phases.insert(phases.end(), other.phases.begin(), other.phases.end());
+    }
+
+    /**
+     * @brief Total time spent in each phase, in order of first appearance
+     */
+    std::vector<std::pair<std::string, int64_t>> get_phase_totals(){
+        std::vector<std::pair<std::string, int64_t>> totals;
+
+        for(PhaseEvent &phase: phases){
+            size_t total_index = 0;
+            while(total_index < totals.size() && totals[total_index].first != phase.name) total_index++;
+
+            if(total_index == totals.size()) totals.push_back(std::pair<std::string, int64_t>(phase.name, 0));
+            totals[total_index].second += phase.duration_ns;
+        }
+
+        return totals;
+    }
+
+    /**
+     * @brief Write the phases as Chrome trace event JSON, viewable in chrome://tracing or Perfetto
+     *
+     * @return std::string The trace
+     */
+    std::string to_chrome_trace(){
+        std::string trace = "{\"traceEvents\":[";
+        int64_t first_start = phases.empty() ? 0 : phases[0].start_ns;
+        char event[256];
+
+        for(PhaseEvent &phase: phases){
+            if(phase.start_ns < first_start) first_start = phase.start_ns;
+        }
+
+        for(size_t phase_index = 0; phase_index < phases.size(); phase_index++){
+            PhaseEvent &phase = phases[phase_index];
+
+            // Complete events, timestamps are in microseconds
+            snprintf(event, sizeof(event), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     phase_index > 0 ? "," : "", phase.name, phase.thread_index,
+                     (phase.start_ns - first_start) / 1000.0, phase.duration_ns / 1000.0);
+            trace += event;
+        }
+
+        trace += "],\"otherData\":{";
+        for(int counter = 0; counter < COUNTER_COUNT; counter++){
+            snprintf(event, sizeof(event), "%s\"%s\":%lld", counter > 0 ? "," : "", counter_names[counter], (long long)counters[counter]);
+            trace += event;
+        }
+        trace += "}}\n";
+
+        return trace;
+    }
+};
+
+/**
+ * @brief The collector for the calling thread, NULL when nothing is being recorded
+ */
+MazeStats*& active_stats(){
+    static thread_local MazeStats *stats = NULL;
+    return stats;
+}
+
+/**
+ * @brief Record into a collector on this thread for as long as the scope lives
+ */
+struct StatsScope{
+    MazeStats *previous_stats;
+
+    StatsScope(MazeStats *stats): previous_stats(active_stats()){
+        active_stats() = stats;
+    }
+
+    ~StatsScope(){
+        active_stats() = previous_stats;
+    }
+};
+
+/**
+ * @brief A small id for the calling thread, numbered in the order threads first record something
+ */
+int get_thread_index(){
+    static std::atomic<int> next_thread_index(0);
+    static thread_local int thread_index = next_thread_index++;
+    return thread_index;
+}
+
+void add_count(Counter counter, int64_t amount){
+    MazeStats *stats = active_stats();
+    if(stats) stats->counters[counter] += amount;
+}
+
+/**
+ * @brief Times its scope as a phase
+ */
+struct PhaseTimer{
+    const char *name;
+    int64_t start_ns;
+
+    PhaseTimer(const char *name): name(name), start_ns(active_stats() ? get_time_ns() : 0){}
+
+    ~PhaseTimer(){
+        MazeStats *stats = active_stats();
+        if(stats && start_ns) stats->phases.push_back(PhaseEvent(name, start_ns, get_time_ns() - start_ns, get_thread_index()));
+    }
+};
+
+/**
+ * @brief Times its scope into a counter instead of a phase, for work done too often to keep every event
+ */
+struct CounterTimer{
+    Counter counter;
+    int64_t start_ns;
+
+    CounterTimer(Counter counter): counter(counter), start_ns(active_stats() ? get_time_ns() : 0){}
+
+    ~CounterTimer(){
+        if(start_ns) add_count(counter, get_time_ns() - start_ns);
+    }
+};
+}
+
+#define INSTRUMENTATION_CONCAT_INNER(a, b) a##b
+#define INSTRUMENTATION_CONCAT(a, b) INSTRUMENTATION_CONCAT_INNER(a, b)
+
+// The hooks library code uses, all of them compile to nothing unless SPELLING_MAZE_INSTRUMENTATION is defined
+#ifdef SPELLING_MAZE_INSTRUMENTATION
+#define MAZE_PHASE(name) Instrumentation::PhaseTimer INSTRUMENTATION_CONCAT(maze_phase_, __LINE__)(name)
+#define MAZE_COUNTER_TIMER(counter) Instrumentation::CounterTimer INSTRUMENTATION_CONCAT(maze_counter_timer_, __LINE__)(Instrumentation::counter)
+#define MAZE_COUNT(counter, amount) Instrumentation::add_count(Instrumentation::counter, amount)
+#else
+#define MAZE_PHASE(name) ((void)0)
+#define MAZE_COUNTER_TIMER(counter) ((void)0)
+#define MAZE_COUNT(counter, amount) ((void)0)
+#endif
+
+#endif
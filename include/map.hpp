@@ -1,163 +1,127 @@
+#include <algorithm>
+#include <cassert>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 #include "utils.hpp"
+#include "cancellation.hpp"
 #include "drawable.hpp"
+#include "font_cache.hpp"
+#include "generators.hpp"
+#include "maze_format.hpp"
 
 #ifndef MAP_H
 #define MAP_H
 
 using namespace Drawable;
 
-struct ObservableList{
+/**
+ * @brief A single maze cell, kept small so a whole grid lives in one contiguous array.
+ * Entry and exits are bitmasks indexed by GridDirection, anything that is neither is a wall.
+ */
+struct Block{
 private:
-    std::vector<GridDirection> direction_list;
+    uint8_t entry_mask;
+    uint8_t exit_mask;
+    char letter;
 public:
+    bool explored;
     bool has_changed;
-    ObservableList(std::vector<GridDirection> list_in): direction_list(list_in), has_changed(false){}
-    ObservableList(): has_changed(false){}
-
-    void remove(GridDirection direction){
-        // Just return if we have no elements
-        if(direction_list.size() < 1) return;
-        // Get our start iterator
-        std::vector<GridDirection>::iterator curr_element = direction_list.begin();
-        // Remove that direction from the list if it exists
-        while(curr_element != direction_list.end()){
-            if(*curr_element == direction){
-                curr_element = direction_list.erase(curr_element);
-                has_changed = true;
-            }else{
-                curr_element++;
-            }
-            
-        }
-
-    }
-
-    void add(GridDirection direction){
-        // Check if this direction already exists in our vector
-        for(GridDirection curr_direction : direction_list){
-            if(curr_direction == direction){
-                return;
-            }
-        }
-        // Don't add a None direction
-        if(direction == None) return;
-        // If we made it this far then we know it isn't already
-        // in the list.
-        direction_list.emplace_back(direction);
-        has_changed = true;
-    }
+    Block(): entry_mask(0), exit_mask(0), letter(0), explored(false), has_changed(true){}
 
-    bool direction_in_list(GridDirection direction){
-        for(GridDirection d : direction_list){
-            if(d == direction) return true;
-        }
-        return false;
-    }
+    void set_letter(char new_letter){
+        if(letter == new_letter) return;
 
-    void clear_list(){
-        direction_list.clear();
+        letter = new_letter;
         has_changed = true;
     }
 
-    int get_size(){
-        return direction_list.size();
+    char get_letter(){
+        return letter;
     }
-};
-
-struct Block: public Drawable2D{
-private:
-    GridDirection entry_direction;
-    ObservableList exit_directions;
-    bool has_changed;
-    char letter;
-public:
-    Color wall_color, background_color;
-    bool explored;
-    Block(int width, int height): Drawable2D(width, height), wall_color(COLOR_BLACK), background_color(COLOR_WHITE), has_changed(true), explored(false), entry_direction(None), letter(0){}
 
-    void set_letter(char new_letter){
-        if(letter == new_letter) return;
+    void set_explored(bool new_explored){
+        if(explored == new_explored) return;
 
-        letter = new_letter;
+        explored = new_explored;
         has_changed = true;
     }
 
     GridDirection get_entry_direction(){
-        return entry_direction;
+        for(int direction = 0; direction < None; direction++){
+            if(entry_mask & direction_bit(GridDirection(direction))) return GridDirection(direction);
+        }
+        return None;
     }
 
     void set_entry_direction(GridDirection direction){
-        if(entry_direction == direction) return;
+        if(entry_mask == direction_bit(direction)) return;
 
-        entry_direction = direction;
+        entry_mask = direction_bit(direction);
         has_changed = true;
     }
 
     bool is_entry_direction(GridDirection direction){
-        return entry_direction == direction;
+        if(direction == None) return entry_mask == 0;
+        return entry_mask & direction_bit(direction);
     }
 
     void remove_exit_direction(GridDirection direction){
-        exit_directions.remove(direction);
+        if(!(exit_mask & direction_bit(direction))) return;
+
+        exit_mask &= ~direction_bit(direction);
+        has_changed = true;
     }
 
     void set_exit_directions(std::vector<GridDirection> &directions){
-        exit_directions.clear_list();
+        clear_exits();
         for(GridDirection direction: directions){
-            exit_directions.add(direction);
+            add_exit_direction(direction);
         }
     }
 
     void add_exit_direction(GridDirection direction){
-        exit_directions.add(direction);
+        if(exit_mask & direction_bit(direction) || direction == None) return;
+
+        exit_mask |= direction_bit(direction);
+        has_changed = true;
     }
 
     bool is_exit_direction(GridDirection direction){
-        return exit_directions.direction_in_list(direction);
+        return exit_mask & direction_bit(direction);
     }
 
     int exit_count(){
-        return exit_directions.get_size();
+        return direction_mask_count(exit_mask);
     }
 
     bool is_mulit_exit(){
-        return exit_directions.get_size() > 1;
+        return exit_count() > 1;
     }
 
     void clear_exits(){
-        exit_directions.clear_list();
-    }
+        if(exit_mask == 0) return;
 
-    Color** draw(){
-        if(!explored){
-            fill(COLOR_BLACK);
-        }else{
-            fill(background_color);
-        }
-
-        for(int direction = 0; direction < None; direction++){
-            if(is_exit_direction(GridDirection(direction)) || is_entry_direction(GridDirection(direction))) continue;
-            draw_edge(GridDirection(direction), wall_color);
-        }
+        exit_mask = 0;
+        has_changed = true;
+    }
 
-        if(letter != 0){
-            // std::cout << "Applying letter!" << std::endl;
-            apply_letter_to_drawable(letter);
-        }
+    uint8_t get_exit_mask(){
+        return exit_mask;
+    }
 
-        return color_array;
+    uint8_t get_wall_mask(){
+        return ~(entry_mask | exit_mask) & ALL_DIRECTIONS_MASK;
     }
 
     void print_debug_info(){
-        std::cout << "Block Info: Entry Direction = " << entry_direction;
+        std::cout << "Block Info: Entry Direction = " << get_entry_direction();
         bool exit_printed = false;
-        if(exit_directions.get_size() > 0){
+        if(exit_mask){
             std::cout << " Exit Directions = ";
         }
         for(int direction = 0; direction < None; direction++){
-            if(exit_directions.direction_in_list(GridDirection(direction))){
+            if(is_exit_direction(GridDirection(direction))){
                 if(exit_printed) std::cout << ", ";
                 std::cout << GridDirection(direction);
                 exit_printed = true;
@@ -170,35 +134,62 @@ public:
 
 struct Map: public Drawable2D{
     int grid_width, grid_height, block_width, block_height;
-    Block **block_grid;
-    Map(int grid_width, int grid_height, int block_width = 10, int block_height = 10): Drawable2D(grid_width * block_width, grid_height * block_height), grid_width(grid_width), grid_height(grid_height), block_width(block_width), block_height(block_height){
-        block_grid = (Block**) calloc(grid_width * grid_height, sizeof(Block*));
-        for(int y = 0; y < grid_height; y++){
-            for(int x = 0; x < grid_width; x++){
-                block_grid[(y * grid_width) + x] = new Block(block_width, block_height);
-            }
-        }
+    Block *block_grid;
+private:
+    Color wall_color, background_color;
+public:
+    // Blocks redrawn by the last call to draw
+    int drawn_block_count;
+    // Maps that are only exported as vectors never allocate or draw pixels
+    bool rasterize;
+    // Each way a block can look is drawn once for the process and copied into the map for every
+    // block that looks that way, NULL when the map isn't rasterized
+    std::shared_ptr<const BlockTiles> block_tiles;
+    Map(int grid_width, int grid_height, int block_width = 10, int block_height = 10, bool rasterize = true): Drawable2D(rasterize ? (int64_t)grid_width * block_width : 0, rasterize ? (int64_t)grid_height * block_height : 0), grid_width(grid_width), grid_height(grid_height), block_width(block_width), block_height(block_height), wall_color(COLOR_BLACK), background_color(COLOR_WHITE), drawn_block_count(0), rasterize(rasterize){
+        block_grid = new Block[grid_width * grid_height];
+        if(rasterize) block_tiles = get_font_cache().get_block_tiles(block_width, block_height, wall_color, background_color, false);
     }
     ~Map(){
+        delete[] block_grid;
+    }
+
+    void mark_all_blocks_changed(){
         for(int block_index = 0; block_index < grid_width * grid_height; block_index++){
-            delete block_grid[block_index];
+            block_grid[block_index].has_changed = true;
         }
+    }
 
-        free(block_grid);
+    Color get_wall_color(){
+        return wall_color;
     }
 
-    std::pair<int, Block*> get_lowest_block(){
-        for(int y = grid_height - 1; y > -1; y--){
-            for(int x = 0; x < grid_width; x++){
-                Block *curr_block = block_grid[(y * grid_width) + x];
+    Color get_background_color(){
+        return background_color;
+    }
 
-                if(curr_block->explored){
-                    return std::pair<int, Block*>(y, curr_block);
-                }
-            }
-        }
+    void set_colors(Color new_wall_color, Color new_background_color){
+        wall_color = new_wall_color;
+        background_color = new_background_color;
+        if(rasterize && !use_block_tiles(block_tiles->has_letters())) throw std::runtime_error("Couldn't load a font to draw the letters with");
+        mark_all_blocks_changed();
+    }
 
-        return std::pair<int, Block*>(-1, NULL);
+    /**
+     * @brief Draw with the shared tiles for the map's block size and colours
+     *
+     * @param lettered Whether the tiles need to draw letters, which loads the font
+     * @return false Letters were wanted and no font could be loaded, the tiles are left as they were
+     */
+    bool use_block_tiles(bool lettered){
+        std::shared_ptr<const BlockTiles> new_block_tiles = get_font_cache().get_block_tiles(block_width, block_height, wall_color, background_color, lettered);
+        if(!new_block_tiles) return false;
+
+        block_tiles = new_block_tiles;
+        return true;
+    }
+
+    Block* get_block(int x, int y){
+        return &block_grid[(y * grid_width) + x];
     }
 
     std::vector<Block*> get_all_explored_blocks(){
@@ -206,7 +197,7 @@ struct Map: public Drawable2D{
 
         for(int y = 0; y < grid_height; y++){
             for(int x = 0; x < grid_width; x++){
-                Block *curr_block = block_grid[(y * grid_width) + x];
+                Block *curr_block = get_block(x, y);
                 if(curr_block->explored) ret_blocks.push_back(curr_block);
             }
         }
@@ -214,15 +205,15 @@ struct Map: public Drawable2D{
         return ret_blocks;
     }
 
-    Block* get_start_block(){
-        int random_index = get_rand_int(0, grid_width - 1);
-        return block_grid[random_index];
+    Block* get_start_block(RandomContext &random){
+        int random_index = random.get_rand_int(0, grid_width - 1);
+        return &block_grid[random_index];
     }
 
     void clean_all_blocks(){
         for(int y = 0; y < grid_height; y++){
             for(int x = 0; x < grid_width; x++){
-                Block *curr_block = block_grid[(y * grid_width) + x];
+                Block *curr_block = get_block(x, y);
                 clean_block_relationships(curr_block);
             }
         }
@@ -260,7 +251,7 @@ struct Map: public Drawable2D{
 
         for(int y = 0; y < grid_height; y++){
             for(int x = 0; x < grid_width; x++){
-                Block *curr_block = block_grid[(y * grid_width) + x];
+                Block *curr_block = get_block(x, y);
 
                 if(curr_block->exit_count() < 2) continue;
 
@@ -271,16 +262,22 @@ struct Map: public Drawable2D{
         return ret_blocks;
     }
 
+    int get_block_index(Block *block){
+        if(!block) return -1;
+
+        int block_index = block - block_grid;
+
+        if(block_index < 0 || block_index >= grid_width * grid_height) return -1;
+
+        return block_index;
+    }
+
     std::pair<int, int> get_block_x_y_tuple(Block *block){
-        for(int y = 0; y < grid_height; y++){
-            for(int x = 0; x < grid_width; x++){
-                Block *curr_block = block_grid[(y * grid_width) + x];
+        int block_index = get_block_index(block);
 
-                if(curr_block == block) return std::pair<int, int>(x, y);
-            }
-        }
+        if(block_index == -1) return std::pair<int, int>(-1, -1);
 
-        return std::pair<int, int>(-1, -1);
+        return std::pair<int, int>(block_index % grid_width, block_index / grid_width);
     }
 
     Block* get_block_in_direction(Block* block, GridDirection direction, bool ignore_explored = true){
@@ -300,9 +297,9 @@ struct Map: public Drawable2D{
         if(check_y >= grid_height || check_y < 0) return NULL;
         if(check_x >= grid_width || check_x < 0) return NULL;
 
-        if(ignore_explored && block_grid[(grid_width * check_y) + check_x]->explored) return NULL;
+        if(ignore_explored && get_block(check_x, check_y)->explored) return NULL;
 
-        return block_grid[(grid_width * check_y) + check_x];
+        return get_block(check_x, check_y);
 
     }
 
@@ -317,33 +314,60 @@ struct Map: public Drawable2D{
         return ret_pair;
     }
 
-    Color** draw(){
+    void draw_block(int x, int y){
+        Block *block = get_block(x, y);
+        const uint8_t *tile = block_tiles->get_tile(block->get_wall_mask(), block->explored, block->get_letter());
+
+        draw_portion(x * block_width, y * block_height, block_width, block_height, tile);
+    }
+
+    /**
+     * @brief Redraw every block whose topology, letter or colours changed since the last draw
+     *
+     * @return uint8_t* The map pixels
+     */
+    uint8_t* draw(){
+        MAZE_PHASE("draw");
+
+        // Cleaning a block can change its neighbours, so settle every changed
+        // block before drawing any of them
+        for(int block_index = 0; block_index < grid_width * grid_height; block_index++){
+            if(Cancellation::is_cancelled(block_index)) return pixels;
+            if(block_grid[block_index].has_changed) clean_block_relationships(&block_grid[block_index]);
+        }
+
+        drawn_block_count = 0;
         for(int y = 0; y < grid_height; y++){
+            if(Cancellation::is_cancelled()) break;
+
             for(int x = 0; x < grid_width; x++){
-                Block *curr_block = block_grid[(y * grid_width) + x];
-                clean_block_relationships(curr_block);
-                draw_portion(x * block_width, y * block_height, block_width, block_height, curr_block->draw());
+                Block *curr_block = get_block(x, y);
+                if(!curr_block->has_changed) continue;
+
+                if(rasterize) draw_block(x, y);
+                curr_block->has_changed = false;
+                drawn_block_count++;
             }
         }
-        return color_array;
-    }
-
-
 
+        MAZE_COUNT(BlocksDrawn, drawn_block_count);
+        return pixels;
+    }
 };
 
 struct Path{
     Map *map;
+    RandomContext *random;
     Block **path;
     int curr_path_len, max_path_len;
     bool complete;
 
-    Path(Map *map, Block *start_block): map(map), curr_path_len(1), max_path_len(1), complete(false){
+    Path(Map *map, RandomContext *random, Block *start_block): map(map), random(random), curr_path_len(1), max_path_len(1), complete(false){
         path = (Block**) calloc(1, sizeof(Block*));
         path[0] = start_block;
     }
 
-    Path(Path* copy_path): map(copy_path->map), curr_path_len(copy_path->curr_path_len), max_path_len(copy_path->max_path_len), complete(copy_path->complete){
+    Path(Path* copy_path): map(copy_path->map), random(copy_path->random), curr_path_len(copy_path->curr_path_len), max_path_len(copy_path->max_path_len), complete(copy_path->complete){
         path = (Block**) calloc(copy_path->max_path_len, sizeof(Block*));
         copy_double_pointer_array(&(copy_path->path), &path, curr_path_len);
     }
@@ -376,54 +400,12 @@ struct Path{
         }
     }
 
-    std::vector<Block*> set_random_exits(Block *block, float chance = 0.6){
-        std::vector<Block*> ret;
-
-        for(std::pair<GridDirection, Block*> dir_block : map->get_blocks_in_all_directions(block)){
-            if(dir_block.second && get_rand_bool(chance)){
-                block->add_exit_direction(dir_block.first);
-                dir_block.second->set_entry_direction(get_opposite_direction(dir_block.first));
-                ret.push_back(dir_block.second);
-            }
-        }
-
-        return ret;
-    }
-
     void add_block(Block *new_block){
         check_path_needs_to_expand();
         path[curr_path_len] = new_block;
         curr_path_len++;
     }
 
-    std::vector<Block*> step_path(){
-        std::vector<Block*> ret;
-        std::vector<Block*> exit_block_list;     
-
-        if(complete) return ret;
-
-        exit_block_list.push_back(path[curr_path_len - 1]);
-
-        while(exit_block_list.size() > 0){
-            Block* current_block = exit_block_list.at(get_rand_int(0, exit_block_list.size() - 1));
-            remove_item_from_vector(exit_block_list, current_block, false);
-            remove_item_from_vector(ret, current_block, false);
-
-            current_block->explored = true;
-
-            if(exit_block_list.size() > 0)
-                ret.insert(ret.end(), exit_block_list.begin(), exit_block_list.end());
-
-            exit_block_list = set_random_exits(current_block);
-
-            check_path_needs_to_expand();
-            path[curr_path_len] = current_block;
-            curr_path_len++;
-        }
-        complete = true;
-        return ret;
-    }
-
     bool block_in_path(Block *block){
         for(int block_index = 0; block_index < curr_path_len; block_index++){
             if(path[block_index] == block) return true;
@@ -434,142 +416,789 @@ struct Path{
 };
 
 struct Maze{
+    RandomContext random;
     Map *map;
     Path *solution_path;
     Block *map_start, *map_end;
+    MazeGenerator *generator;
+    GeneratorType generator_type;
+    // Steps from map_start to every block, filled in by solve_maze, -1 where a block can't be reached
+    std::vector<int> distance_from_start;
+    // One bit per block, set for the blocks on solution_path
+    std::vector<bool> on_solution_path;
 
-    Maze(int grid_width, int grid_height, int block_width, int block_height){
-        map = new Map(grid_width, grid_height, block_width, block_height);
+    Maze(int grid_width, int grid_height, int block_width, int block_height, uint64_t seed, bool rasterize = true, GeneratorType generator_type = GrowingTree): random(seed), solution_path(NULL), generator_type(generator_type){
+        map = new Map(grid_width, grid_height, block_width, block_height, rasterize);
+        generator = create_generator(generator_type);
 
         generate_maze();
+        if(Cancellation::is_cancelled()) return;
         solve_maze();
     }
 
+    /**
+     * @brief Copy a generated and solved maze, so one skeleton can be drawn at any block size or
+     * built on without changing it. The copy carries on the skeleton's random stream, so it ends
+     * up exactly as a maze made with the skeleton's seed would.
+     *
+     * @param skeleton The maze to copy
+     * @param block_width Block width to draw with
+     * @param block_height Block height to draw with
+     */
+    Maze(Maze &skeleton, int block_width, int block_height, bool rasterize = true): random(skeleton.random), solution_path(NULL), generator_type(skeleton.generator_type), distance_from_start(skeleton.distance_from_start), on_solution_path(skeleton.on_solution_path){
+        MAZE_PHASE("copy_skeleton");
+        int grid_width = skeleton.map->grid_width, grid_height = skeleton.map->grid_height;
+
+        map = new Map(grid_width, grid_height, block_width, block_height, rasterize);
+        generator = create_generator(generator_type);
+
+        std::copy(skeleton.map->block_grid, skeleton.map->block_grid + grid_width * grid_height, map->block_grid);
+        map->mark_all_blocks_changed();
+        map_start = &map->block_grid[skeleton.map->get_block_index(skeleton.map_start)];
+        map_end = &map->block_grid[skeleton.map->get_block_index(skeleton.map_end)];
+
+        if(skeleton.solution_path){
+            solution_path = new Path(map, &random, map_start);
+            solution_path->expand_max_path_length(skeleton.solution_path->curr_path_len);
+            solution_path->curr_path_len = skeleton.solution_path->curr_path_len;
+            for(int path_index = 0; path_index < solution_path->curr_path_len; path_index++){
+                solution_path->path[path_index] = &map->block_grid[skeleton.map->get_block_index(skeleton.solution_path->path[path_index])];
+            }
+            solution_path->complete = skeleton.solution_path->complete;
+        }
+    }
+
+    /**
+     * @brief Rebuild a stored maze instead of generating one, the blocks come out exactly as they
+     * were saved and only need drawing
+     *
+     * @param record A maze read by MazeFormat::decode
+     * @param block_width Block width to draw with, it doesn't have to match the saved maze's
+     * @param block_height Block height to draw with
+     */
+    Maze(MazeFormat::MazeRecord &record, int block_width, int block_height, bool rasterize = true): random(record.seed), solution_path(NULL), generator_type(GeneratorType(record.generator_type)){
+        MAZE_PHASE("load");
+        size_t block_count = record.get_block_count();
+
+        map = new Map(record.grid_width, record.grid_height, block_width, block_height, rasterize);
+        generator = create_generator(generator_type);
+
+        for(size_t block_index = 0; block_index < block_count; block_index++){
+            Block *block = &map->block_grid[block_index];
+            GridDirection entry = GridDirection(record.entry_directions[block_index]);
+
+            block->set_letter(record.letters[block_index]);
+            if(record.distance_from_start[block_index] == -1) continue;
+
+            block->set_explored(true);
+            if(entry != None) block->set_entry_direction(entry);
+            for(int direction = 0; direction < None; direction++){
+                if(direction != entry && record.open_masks[block_index] & direction_bit(GridDirection(direction))) block->add_exit_direction(GridDirection(direction));
+            }
+        }
+
+        map_start = &map->block_grid[record.start_index];
+        map_end = &map->block_grid[record.end_index];
+        distance_from_start = record.distance_from_start;
+        on_solution_path.assign(block_count, false);
+
+        if(record.has_solution){
+            solution_path = new Path(map, &random, map_start);
+            solution_path->expand_max_path_length(record.solution_steps.size() + 1);
+            solution_path->curr_path_len = record.solution_steps.size() + 1;
+            on_solution_path[record.start_index] = true;
+
+            Block *curr_block = map_start;
+            for(size_t step_index = 0; step_index < record.solution_steps.size(); step_index++){
+                curr_block = map->get_block_in_direction(curr_block, GridDirection(record.solution_steps[step_index]), false);
+                solution_path->path[step_index + 1] = curr_block;
+                on_solution_path[map->get_block_index(curr_block)] = true;
+            }
+            solution_path->complete = true;
+        }
+    }
+
     ~Maze(){
+        delete solution_path;
+        delete generator;
         delete map;
     }
 
-    void generate_paths(Block *start_block){
-        std::vector<Block*> possible_path_starts;
-        std::vector<Block*> new_exits;
-        possible_path_starts.push_back(start_block);
+    /**
+     * @brief Carve every unexplored block the roots can reach into the maze with the generator,
+     * then walk the new passages out from the roots to give each block its entry and exits
+     *
+     * @param roots Explored blocks the new passages may start from
+     */
+    void carve_from_roots(std::vector<Block*> &roots){
+        CarveRegion region(map->grid_width, map->grid_height);
+        std::vector<Passage> passages;
+
+        for(int block_index = 0; block_index < region.get_cell_count(); block_index++){
+            if(!map->block_grid[block_index].explored) region.cell_states[block_index] = REGION_CARVABLE;
+        }
+        for(Block *root: roots){
+            region.cell_states[map->get_block_index(root)] = REGION_ROOT;
+        }
 
-        while(possible_path_starts.size() > 0){
-            Block *current_start = possible_path_starts.at(get_rand_int(0, possible_path_starts.size() - 1));
-            remove_item_from_vector(possible_path_starts, current_start, false);
+        region.exclude_unreachable_cells();
+        generator->carve(region, random, passages);
+        MAZE_COUNT(CarvePasses, 1);
+        MAZE_COUNT(CarvedPassages, passages.size());
+        if(Cancellation::is_cancelled()) return;
+
+        // Generators don't say which end of a passage was in the tree first, so orient them from the roots
+        std::vector<uint8_t> open_masks(region.get_cell_count(), 0);
+        for(Passage &passage: passages){
+            open_masks[passage.first] |= direction_bit(region.get_direction(passage.first, passage.second));
+            open_masks[passage.second] |= direction_bit(region.get_direction(passage.second, passage.first));
+        }
 
-            if(current_start->explored) continue;
+        std::vector<bool> reached(region.get_cell_count(), false);
+        std::vector<int> search_queue;
+        for(Block *root: roots){
+            reached[map->get_block_index(root)] = true;
+            search_queue.push_back(map->get_block_index(root));
+        }
 
-            Path *path = new Path(map, current_start);
+        for(size_t queue_head = 0; queue_head < search_queue.size(); queue_head++){
+            int curr_index = search_queue[queue_head];
 
-            while(!path->complete){
-                new_exits = path->step_path();
-                if(new_exits.size() > 0)
-                    possible_path_starts.insert(possible_path_starts.end(), new_exits.begin(), new_exits.end());
-            }
+            for(int direction = 0; direction < None; direction++){
+                if(!(open_masks[curr_index] & direction_bit(GridDirection(direction)))) continue;
 
-            delete path;
+                int next_index = region.get_neighbour(curr_index, GridDirection(direction));
+                if(reached[next_index]) continue;
 
+                Block *next_block = &map->block_grid[next_index];
+                map->block_grid[curr_index].add_exit_direction(GridDirection(direction));
+                next_block->set_entry_direction(get_opposite_direction(GridDirection(direction)));
+                next_block->set_explored(true);
+
+                reached[next_index] = true;
+                search_queue.push_back(next_index);
+            }
         }
     }
 
     void generate_maze(){
-        Block* new_start;
-        map_start = map->get_start_block();
-        map_end = NULL;
+        MAZE_PHASE("generate");
+        map_start = map->get_start_block(random);
         map_start->set_entry_direction(North);
+        map_start->set_explored(true);
 
-        new_start = map_start;
-
-        while(!map_end){
-            generate_paths(new_start);
+        std::vector<Block*> roots(1, map_start);
+        carve_from_roots(roots);
 
-            std::pair<int, Block*> lowest_location = map->get_lowest_block();
-            lowest_location.second->add_exit_direction(South);
+        // The whole grid is connected, so the exit can be any block on the bottom row
+        map_end = map->get_block(random.get_rand_int(0, map->grid_width - 1), map->grid_height - 1);
+        map_end->add_exit_direction(South);
 
-            if(lowest_location.first == map->grid_height - 1){
-                map_end = lowest_location.second;
-            }else{
-                new_start = map->get_block_in_direction(lowest_location.second, South);
-                new_start->set_entry_direction(North);
-            }
-        }
-        
         map->draw();
     }
 
+    /**
+     * @brief Breadth first search along the block exits from map_start, keeping one parent and
+     * one distance per block, then walk the parents back from map_end to build the solution
+     */
     void solve_maze(){
-        std::vector<Path*> exploring_paths;
-        std::vector<Path*> temp_exploring_paths;
-        Block *start = map_start;
+        MAZE_PHASE("solve");
+        int block_count = map->grid_width * map->grid_height;
+        std::vector<int> parent_index(block_count, -1);
+        std::vector<int> search_queue;
+        int start_index = map->get_block_index(map_start);
+        int end_index = map->get_block_index(map_end);
+
+        delete solution_path;
         solution_path = NULL;
-        
-        exploring_paths.push_back(new Path(map, start));
-
-        while(!solution_path && exploring_paths.size() > 0){
-            temp_exploring_paths = exploring_paths;
-            for(Path *path : temp_exploring_paths){
-                Block *curr_block = path->path[path->curr_path_len - 1];
-
-                if(curr_block->exit_count() == 0 && curr_block != map_end){
-                    remove_item_from_vector(exploring_paths, path); 
-                    continue;
-                }else if(curr_block == map_end){
-                    solution_path = path;
-                    for(Path* possible_path : exploring_paths){
-                        if(possible_path != solution_path){
-                            delete possible_path;
-                        }
-                    }
-                    break;
-                }
+        distance_from_start.assign(block_count, -1);
+        on_solution_path.assign(block_count, false);
+        search_queue.reserve(block_count);
 
-                if(curr_block->is_mulit_exit()){
-                    for(int direction = 0; direction < None; direction++){
-                        if(curr_block->is_exit_direction(GridDirection(direction))){
-                            Path *new_path = new Path(path);
-                            Block *next_block = map->get_block_in_direction(curr_block, GridDirection(direction), false);
-                            new_path->add_block(next_block);
-                            exploring_paths.push_back(new_path);
-                        }
-                    }
-                    remove_item_from_vector(exploring_paths, path);
-                }else{
-                    for(int direction = 0; direction < None; direction++){
-                        if(curr_block->is_exit_direction(GridDirection(direction))){
-                            Block *next_block = map->get_block_in_direction(curr_block, GridDirection(direction), false);
-                            path->add_block(next_block);
-                        }
-                    }
-                }
+        distance_from_start[start_index] = 0;
+        search_queue.push_back(start_index);
+
+        for(size_t queue_head = 0; queue_head < search_queue.size(); queue_head++){
+            int curr_index = search_queue[queue_head];
+            Block *curr_block = &map->block_grid[curr_index];
+
+            for(int direction = 0; direction < None; direction++){
+                if(!curr_block->is_exit_direction(GridDirection(direction))) continue;
+
+                int next_index = map->get_block_index(map->get_block_in_direction(curr_block, GridDirection(direction), false));
+                if(next_index == -1 || distance_from_start[next_index] != -1) continue;
+
+                distance_from_start[next_index] = distance_from_start[curr_index] + 1;
+                parent_index[next_index] = curr_index;
+                search_queue.push_back(next_index);
             }
         }
+
+        if(end_index != -1 && distance_from_start[end_index] != -1){
+            int path_length = distance_from_start[end_index] + 1;
+
+            solution_path = new Path(map, &random, map_start);
+            solution_path->expand_max_path_length(path_length);
+            solution_path->curr_path_len = path_length;
+
+            for(int curr_index = end_index, path_index = path_length - 1; path_index >= 0; curr_index = parent_index[curr_index], path_index--){
+                solution_path->path[path_index] = &map->block_grid[curr_index];
+                on_solution_path[curr_index] = true;
+            }
+            solution_path->complete = true;
+        }
         
         map->clean_all_blocks();
     }
 
-    void save_to_png(std::string filename){
-        map->save_array_as_png(filename);
+    bool is_on_solution_path(Block *block){
+        int block_index = map->get_block_index(block);
+
+        if(block_index == -1 || on_solution_path.empty()) return false;
+
+        return on_solution_path[block_index];
+    }
+
+    /**
+     * @brief Get how many steps a block is from the start along the maze exits
+     *
+     * @param block The block
+     * @return int The distance, -1 if the block can't be reached from the start
+     */
+    int get_distance_from_start(Block *block){
+        int block_index = map->get_block_index(block);
+
+        if(block_index == -1 || distance_from_start.empty()) return -1;
+
+        return distance_from_start[block_index];
+    }
+
+    /**
+     * @brief Get the junctions on the solution path, in grid order. The end block's exit off the
+     * grid can't carry a letter, so it never counts.
+     *
+     * @return std::vector<int> Block indexes of the junctions
+     */
+    std::vector<int> get_solution_path_junctions(){
+        std::vector<int> ret;
+        int end_index = map->get_block_index(map_end);
+
+        for(int block_index = 0; block_index < map->grid_width * map->grid_height; block_index++){
+            if(block_index == end_index) continue;
+            if(on_solution_path[block_index] && map->block_grid[block_index].exit_count() > 1){
+                ret.push_back(block_index);
+            }
+        }
+
+        return ret;
+    }
+
+    bool save_to_png(std::string filename, PngWriter::ImageOptions options = PngWriter::ImageOptions()){
+        return map->save_array_as_png(filename, options);
+    }
+
+    std::vector<uint8_t> encode_to_png(PngWriter::ImageOptions options = PngWriter::ImageOptions()){
+        return map->encode_array_as_png(options);
+    }
+
+    /**
+     * @brief Get everything needed to rebuild the maze, see MazeFormat::MazeRecord
+     */
+    MazeFormat::MazeRecord to_record(){
+        MazeFormat::MazeRecord record;
+        int block_count = map->grid_width * map->grid_height;
+
+        record.grid_width = map->grid_width;
+        record.grid_height = map->grid_height;
+        record.seed = random.seed;
+        record.generator_type = generator_type;
+        record.start_index = map->get_block_index(map_start);
+        record.end_index = map->get_block_index(map_end);
+        record.open_masks.resize(block_count);
+        record.letters.resize(block_count);
+
+        for(int block_index = 0; block_index < block_count; block_index++){
+            record.open_masks[block_index] = ~map->block_grid[block_index].get_wall_mask() & ALL_DIRECTIONS_MASK;
+            record.letters[block_index] = map->block_grid[block_index].get_letter();
+        }
+
+        if(solution_path){
+            record.has_solution = true;
+            for(int path_index = 1; path_index < solution_path->curr_path_len; path_index++){
+                int step = map->get_block_index(solution_path->path[path_index]) - map->get_block_index(solution_path->path[path_index - 1]);
+
+                if(step == -map->grid_width) record.solution_steps.push_back(North);
+                else if(step == map->grid_width) record.solution_steps.push_back(South);
+                else if(step == -1) record.solution_steps.push_back(West);
+                else record.solution_steps.push_back(East);
+            }
+        }
+
+        return record;
+    }
+
+    std::vector<uint8_t> serialize(){
+        return MazeFormat::encode(to_record());
     }
 };
 
 struct WordMaze: public Maze{
     std::string word;
-    WordMaze(std::string word, int grid_width = 20, int grid_height = 20, int block_width = 20, int block_height = 20): Maze(grid_width, grid_height, block_width, block_height), word(word){
-        sf::Font font;
+    // Letters that aren't in the word, used to letter the branches off the solution path
+    std::vector<char> decoy_letters;
+    WordMaze(std::string word, int grid_width = 20, int grid_height = 20, int block_width = 20, int block_height = 20, uint64_t seed = RandomContext::random_seed(), bool rasterize = true, GeneratorType generator_type = GrowingTree): Maze(grid_width, grid_height, block_width, block_height, seed, rasterize, generator_type), word(word){
+        spell_word();
+    }
 
-        if(!font.loadFromFile("../res/font.ttf")){
-            std::cout << "Couldn't load font!" << std::endl;
-            std::raise(SIGTERM);
-        }
+    /**
+     * @brief Put a word on a copy of an already generated maze, skipping generation and solving
+     *
+     * @param skeleton A solved maze of the grid size wanted, left unchanged
+     */
+    WordMaze(std::string word, Maze &skeleton, int block_width = 20, int block_height = 20, bool rasterize = true): Maze(skeleton, block_width, block_height, rasterize), word(word){
+        spell_word();
+    }
 
-        for(int block_index = 0; block_index < grid_height * grid_width; block_index++){
-            map->block_grid[block_index]->font = &font;
-        }
+    /**
+     * @brief Draw a stored maze, see Maze's MazeRecord constructor
+     */
+    WordMaze(MazeFormat::MazeRecord &record, int block_width = 20, int block_height = 20, bool rasterize = true): Maze(record, block_width, block_height, rasterize), word(record.word){
+        // Stored blocks are already settled, so without pixels to draw there is nothing left to do
+        if(!rasterize) return;
+
+        use_lettered_block_tiles();
+        map->draw();
+    }
+
+    /**
+     * @brief Read and draw a maze saved with serialize
+     *
+     * @return WordMaze* The maze, NULL if the data isn't a valid stored maze
+     */
+    static WordMaze* deserialize(const uint8_t *data, size_t size, int block_width = 20, int block_height = 20, bool rasterize = true){
+        MazeFormat::MazeRecord record;
+
+        if(!MazeFormat::decode(data, size, record)) return NULL;
+
+        return new WordMaze(record, block_width, block_height, rasterize);
+    }
+
+    MazeFormat::MazeRecord to_record(){
+        MazeFormat::MazeRecord record = Maze::to_record();
+        record.word = word;
+        return record;
+    }
+
+    std::vector<uint8_t> serialize(){
+        return MazeFormat::encode(to_record());
+    }
+
+    /**
+     * @brief Everything after the maze is solved, fitting the word in, lettering and drawing
+     */
+    void spell_word(){
+        if(map->rasterize) use_lettered_block_tiles();
+
+        // A cancelled maze is left half built between phases, whoever cancelled it throws it away
+        if(Cancellation::is_cancelled()) return;
+        make_room_for_word();
+        if(Cancellation::is_cancelled()) return;
         apply_word();
+        if(Cancellation::is_cancelled()) return;
         map->draw();
     }
 
+    void use_lettered_block_tiles(){
+        if(!map->use_block_tiles(true)) throw std::runtime_error("Couldn't load a font to draw the letters with");
+    }
+
+    /**
+     * @brief Junctions a comb shaped solution path gives a grid. The path snakes along every other
+     * row, or down every other column, and each block it passes gets the block beside it in the
+     * row or column in between as its branch.
+     *
+     * @param grid_width Grid width in blocks
+     * @param grid_height Grid height in blocks
+     * @param vertical Set to whether the columns give more junctions than the rows
+     * @return int The junctions, not counting the end
+     */
+    static int get_comb_junction_count(int grid_width, int grid_height, bool &vertical){
+        vertical = false;
+        if(grid_width < 2 || grid_height < 2) return 0;
+
+        int row_junctions = (grid_height / 2) * (grid_width - 1);
+
+        // An odd number of path columns, so the path finishes going down onto the bottom row
+        int path_columns = (grid_width + 1) / 2;
+        if(path_columns % 2 == 0) path_columns--;
+        int branch_columns = path_columns - 1 + (2 * path_columns - 1 < grid_width ? 1 : 0);
+        int column_junctions = branch_columns * (grid_height - 1);
+
+        vertical = column_junctions > row_junctions;
+        return std::max(row_junctions, column_junctions);
+    }
+
+    /**
+     * @brief Check whether a word can fit in a grid, cheap enough to call before building anything.
+     * Every letter needs a junction on the solution path other than the end, this accepts as many
+     * letters as the comb path from build_comb_solution_path can hold.
+     *
+     * @param word_length Letters in the word
+     * @param grid_width Grid width in blocks
+     * @param grid_height Grid height in blocks
+     * @return true Generation always places the word
+     * @return false The word is too long for the grid
+     */
+    static bool word_fits(size_t word_length, int grid_width, int grid_height){
+        if(grid_width < 1 || grid_height < 1) return false;
+        if(word_length == 0) return true;
+
+        bool vertical;
+        return word_length <= (size_t)get_comb_junction_count(grid_width, grid_height, vertical);
+    }
+
+    /**
+     * @brief Make child the block entered from its neighbour parent
+     */
+    void connect_blocks(Block *parent, Block *child){
+        for(int direction = 0; direction < None; direction++){
+            if(map->get_block_in_direction(parent, GridDirection(direction), false) != child) continue;
+
+            parent->add_exit_direction(GridDirection(direction));
+            child->set_entry_direction(get_opposite_direction(GridDirection(direction)));
+            parent->set_explored(true);
+            child->set_explored(true);
+            return;
+        }
+    }
+
+    /**
+     * @brief Count the junctions of a comb path cut short after its first few rows or columns. Past
+     * the last row the path goes straight down the side to the bottom row, branching off sideways.
+     *
+     * @param path_lines Rows or columns the path runs along, columns must be odd to finish at the bottom
+     */
+    static int get_short_comb_junction_count(int grid_width, int grid_height, bool vertical, int path_lines){
+        int junctions = 0;
+
+        if(vertical){
+            for(int column = 0; column < path_lines; column++){
+                if(column * 2 + 1 < grid_width) junctions += grid_height - 1;
+            }
+            return junctions;
+        }
+
+        for(int row = 0; row < path_lines; row++){
+            if(row * 2 + 1 < grid_height) junctions += grid_width - 1;
+        }
+        // The first block down is already the last branch of the row above, and the end can't branch
+        if(grid_width > 1) junctions += std::max(0, grid_height - 3 - (path_lines - 1) * 2);
+        return junctions;
+    }
+
+    /**
+     * @brief Rebuild the maze around a comb shaped solution path with as few rows or columns as hold
+     * the word, which get_comb_junction_count says every word word_fits accepts can. The areas
+     * between the rows each need a letter's junction to reach them, and the rest is beside the end,
+     * so fill out can always reach every block.
+     */
+    void build_comb_solution_path(){
+        int grid_width = map->grid_width, grid_height = map->grid_height;
+        std::vector<int> path_indices;
+        std::vector<std::pair<int, int>> branches;
+        bool vertical;
+        get_comb_junction_count(grid_width, grid_height, vertical);
+        bool mirrored = random.get_rand_int(0, 1);
+
+        int path_columns = (grid_width + 1) / 2;
+        if(path_columns % 2 == 0) path_columns--;
+        int max_path_lines = vertical ? path_columns : (grid_height + 1) / 2;
+        int path_lines = 1;
+        while(path_lines < max_path_lines && get_short_comb_junction_count(grid_width, grid_height, vertical, path_lines) < (int)word.length()){
+            path_lines += vertical ? 2 : 1;
+        }
+
+        if(!vertical){
+            for(int row = 0; row < path_lines; row++){
+                int y = row * 2;
+                bool reversed = row % 2;
+                int side_x = reversed ? 0 : grid_width - 1;
+
+                for(int step = 0; step < grid_width; step++){
+                    int x = reversed ? grid_width - 1 - step : step;
+                    path_indices.push_back(y * grid_width + x);
+                    if(step < grid_width - 1 && y + 1 < grid_height) branches.push_back(std::pair<int, int>(y * grid_width + x, (y + 1) * grid_width + x));
+                }
+
+                // Down through the row in between to the next path row, or after the last one all the way to the bottom row
+                int next_y = row < path_lines - 1 ? y + 2 : grid_height;
+                for(int down_y = y + 1; down_y < next_y; down_y++){
+                    path_indices.push_back(down_y * grid_width + side_x);
+                    if(down_y > y + 1 && down_y < grid_height - 1 && grid_width > 1) branches.push_back(std::pair<int, int>(down_y * grid_width + side_x, down_y * grid_width + (reversed ? 1 : grid_width - 2)));
+                }
+            }
+        }
+        else{
+            path_columns = path_lines;
+
+            for(int column = 0; column < path_columns; column++){
+                int x = column * 2;
+                bool reversed = column % 2;
+
+                for(int step = 0; step < grid_height; step++){
+                    int y = reversed ? grid_height - 1 - step : step;
+                    path_indices.push_back(y * grid_width + x);
+                    if(step < grid_height - 1 && x + 1 < grid_width) branches.push_back(std::pair<int, int>(y * grid_width + x, y * grid_width + x + 1));
+                }
+
+                // Across the column in between at the turn
+                if(column < path_columns - 1) path_indices.push_back((reversed ? 0 : grid_height - 1) * grid_width + x + 1);
+            }
+        }
+
+        for(int block_index = 0; block_index < grid_width * grid_height; block_index++){
+            map->block_grid[block_index] = Block();
+        }
+
+        if(mirrored){
+            for(int &block_index: path_indices) block_index = (block_index / grid_width) * grid_width + grid_width - 1 - block_index % grid_width;
+            for(std::pair<int, int> &branch: branches){
+                branch.first = (branch.first / grid_width) * grid_width + grid_width - 1 - branch.first % grid_width;
+                branch.second = (branch.second / grid_width) * grid_width + grid_width - 1 - branch.second % grid_width;
+            }
+        }
+
+        map_start = &map->block_grid[path_indices.front()];
+        map_start->set_entry_direction(North);
+        map_start->set_explored(true);
+        for(size_t path_index = 1; path_index < path_indices.size(); path_index++){
+            connect_blocks(&map->block_grid[path_indices[path_index - 1]], &map->block_grid[path_indices[path_index]]);
+        }
+        map_end = &map->block_grid[path_indices.back()];
+        map_end->add_exit_direction(South);
+
+        for(std::pair<int, int> &branch: branches){
+            connect_blocks(&map->block_grid[branch.first], &map->block_grid[branch.second]);
+        }
+
+        MAZE_COUNT(CombPaths, 1);
+    }
+
+    /**
+     * @brief Move a block, along with everything hanging off it, to hang off a neighbour instead
+     *
+     * @param block The block to move
+     * @param new_parent Neighbour it is entered from afterwards
+     * @param direction Direction from new_parent to block
+     */
+    void reparent_block(Block *block, Block *new_parent, GridDirection direction){
+        GridDirection entry = block->get_entry_direction();
+        Block *old_parent = map->get_block_in_direction(block, entry, false);
+
+        if(old_parent) old_parent->remove_exit_direction(get_opposite_direction(entry));
+
+        new_parent->add_exit_direction(direction);
+        block->set_entry_direction(get_opposite_direction(direction));
+    }
+
+    /**
+     * @brief Try to give a solution block a branch of its own, taking one from another solution
+     * block when that block can be given a different one (an augmenting path)
+     *
+     * @param path_index The solution block, as an index into the path
+     * @param branch_owners Path index each block off the path is matched to, -1 if none
+     * @param visit_stamps Search each block was last visited in
+     * @param stamp The current search
+     * @return true The block was matched
+     */
+    bool match_branch(int path_index, std::vector<int> &branch_owners, std::vector<int> &visit_stamps, int stamp){
+        Block *path_block = solution_path->path[path_index];
+
+        for(int direction = 0; direction < None; direction++){
+            Block *branch_block = map->get_block_in_direction(path_block, GridDirection(direction), false);
+            if(!branch_block || !branch_block->explored || is_on_solution_path(branch_block)) continue;
+
+            int branch_index = map->get_block_index(branch_block);
+            if(visit_stamps[branch_index] == stamp) continue;
+            visit_stamps[branch_index] = stamp;
+
+            if(branch_owners[branch_index] == -1 || match_branch(branch_owners[branch_index], branch_owners, visit_stamps, stamp)){
+                branch_owners[branch_index] = path_index;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Turn solution blocks into junctions by moving a neighbouring branch onto each of them.
+     * Every branch can only serve one block, so the branches are matched to the blocks first. A block
+     * off the solution path is never an ancestor of one on it, so the moves always leave a tree.
+     *
+     * @param wanted Junctions wanted
+     * @return int Solution blocks given a branch, at most wanted
+     */
+    int match_branches_onto_solution_path(int wanted){
+        int block_count = map->grid_width * map->grid_height;
+        std::vector<int> branch_owners(block_count, -1), visit_stamps(block_count, -1), path_order;
+        int matched = 0;
+
+        // The end can't carry a letter, so only the blocks before it
+        for(int path_index = 0; path_index < solution_path->curr_path_len - 1; path_index++){
+            path_order.push_back(path_index);
+        }
+        for(int order_index = path_order.size() - 1; order_index > 0; order_index--){
+            std::swap(path_order[order_index], path_order[random.get_rand_int(0, order_index)]);
+        }
+
+        for(int path_index: path_order){
+            if(matched >= wanted) break;
+            if(match_branch(path_index, branch_owners, visit_stamps, path_index)) matched++;
+        }
+
+        for(int branch_index = 0; branch_index < block_count; branch_index++){
+            if(branch_owners[branch_index] == -1) continue;
+
+            Block *path_block = solution_path->path[branch_owners[branch_index]];
+            for(int direction = 0; direction < None; direction++){
+                if(map->get_block_in_direction(path_block, GridDirection(direction), false) != &map->block_grid[branch_index]) continue;
+
+                if(!path_block->is_exit_direction(GridDirection(direction))){
+                    reparent_block(&map->block_grid[branch_index], path_block, GridDirection(direction));
+                    MAZE_COUNT(ReparentedBlocks, 1);
+                }
+                break;
+            }
+        }
+
+        return matched;
+    }
+
+    /**
+     * @brief Lengthen the solution path by routing one step of it around two blocks beside it,
+     * giving it more blocks that can become junctions
+     *
+     * @return true A detour was made
+     * @return false No step of the path has two free blocks beside it
+     */
+    bool add_solution_path_detour(){
+        int path_length = solution_path->curr_path_len;
+        int first_index = random.get_rand_int(0, path_length - 1);
+
+        for(int offset = 0; offset < path_length - 1; offset++){
+            int path_index = (first_index + offset) % (path_length - 1);
+            Block *from_block = solution_path->path[path_index], *to_block = solution_path->path[path_index + 1];
+            GridDirection step = to_block->get_entry_direction() == None ? None : get_opposite_direction(to_block->get_entry_direction());
+
+            for(int direction = 0; direction < None; direction++){
+                GridDirection side = GridDirection(direction);
+                if(side == step || side == get_opposite_direction(step)) continue;
+
+                Block *side_from = map->get_block_in_direction(from_block, side, false);
+                Block *side_to = map->get_block_in_direction(to_block, side, false);
+                if(!side_from || !side_to || !side_from->explored || !side_to->explored) continue;
+                if(is_on_solution_path(side_from) || is_on_solution_path(side_to)) continue;
+
+                // from -> side_from -> side_to -> to, the old step goes when to is moved
+                reparent_block(side_from, from_block, side);
+                reparent_block(side_to, side_from, step);
+                reparent_block(to_block, side_to, get_opposite_direction(side));
+                MAZE_COUNT(PathDetours, 1);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Cut across to a later block of the solution path that is right beside an earlier one.
+     * The blocks skipped become a branch, so the earlier block becomes a junction and the path
+     * frees up blocks beside it.
+     *
+     * @return true A shortcut was made
+     * @return false No two blocks of the path are beside each other
+     */
+    bool add_solution_path_shortcut(){
+        int path_length = solution_path->curr_path_len;
+        int first_index = random.get_rand_int(0, path_length - 1);
+
+        for(int offset = 0; offset < path_length; offset++){
+            int path_index = (first_index + offset) % path_length;
+            Block *from_block = solution_path->path[path_index];
+
+            for(int direction = 0; direction < None; direction++){
+                Block *later_block = map->get_block_in_direction(from_block, GridDirection(direction), false);
+                if(!is_on_solution_path(later_block)) continue;
+
+                // Only blocks further along than the next one
+                if(get_distance_from_start(later_block) <= path_index + 1) continue;
+
+                reparent_block(later_block, from_block, GridDirection(direction));
+                MAZE_COUNT(PathShortcuts, 1);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Move the exit to another block of the bottom row, giving the path a different route
+     * when it can't be reshaped any further where it is
+     *
+     * @return true The exit moved
+     * @return false The bottom row only has the one block
+     */
+    bool move_solution_path_end(){
+        if(map->grid_width < 2) return false;
+
+        int end_x = random.get_rand_int(0, map->grid_width - 2);
+        if(end_x >= map->get_block_index(map_end) % map->grid_width) end_x++;
+
+        map_end->remove_exit_direction(South);
+        map_end = map->get_block(end_x, map->grid_height - 1);
+        map_end->add_exit_direction(South);
+        MAZE_COUNT(PathEndMoves, 1);
+        return true;
+    }
+
+    /**
+     * @brief Build junctions onto the solution path until every letter of the word has one. The path
+     * is lengthened while it has fewer blocks than letters and shortened when it is boxed in, if
+     * that doesn't get there the maze is rebuilt around a comb path, which always does for words
+     * word_fits accepts.
+     */
+    void make_room_for_word(){
+        MAZE_PHASE("make_room_for_word");
+        bool changed = false;
+        // Every reshape can add a junction or two, so a few per letter is plenty when it works at all
+        int reshape_limit = 8 * word.length();
+
+        for(int reshape_count = 0; solution_path && reshape_count < reshape_limit; reshape_count++){
+            if(Cancellation::is_cancelled()) return;
+            if(get_solution_path_junctions().size() >= word.length()) break;
+
+            changed = true;
+            if(match_branches_onto_solution_path(word.length()) >= (int)word.length()) break;
+
+            bool path_too_short = solution_path->curr_path_len - 1 < (int)word.length();
+            bool reshaped = path_too_short ? add_solution_path_detour() || add_solution_path_shortcut() : add_solution_path_shortcut() || add_solution_path_detour();
+            if(!reshaped) reshaped = move_solution_path_end();
+            if(!reshaped) break;
+
+            solve_maze();
+        }
+
+        if(changed) solve_maze();
+
+        if(solution_path && get_solution_path_junctions().size() < word.length() && word_fits(word.length(), map->grid_width, map->grid_height)){
+            build_comb_solution_path();
+            solve_maze();
+        }
+    }
+
     void close_and_unexplore_connected_blocks(Block *block){
         std::vector<Block*> blocks_to_clear;
         Block *exit_block = map->get_block_in_direction(block, block->get_entry_direction(), false);
@@ -577,17 +1206,13 @@ struct WordMaze: public Maze{
         exit_block->remove_exit_direction(get_opposite_direction(block->get_entry_direction()));
         blocks_to_clear.push_back(block);
 
-        while(blocks_to_clear.size() > 0){
-            Block *curr_block = blocks_to_clear.at(0);
-            blocks_to_clear.erase(blocks_to_clear.begin());
+        for(size_t clear_index = 0; clear_index < blocks_to_clear.size(); clear_index++){
+            Block *curr_block = blocks_to_clear[clear_index];
 
-            if(!curr_block) {
-                std::cout << "Continuing!" << std::endl;
-                continue;
-            }
+            if(!curr_block) continue;
 
             curr_block->set_entry_direction(None);
-            curr_block->explored = false;
+            curr_block->set_explored(false);
 
             for(int direction = 0; direction < None; direction++){
                 if(curr_block->is_exit_direction(GridDirection(direction))){
@@ -601,15 +1226,13 @@ struct WordMaze: public Maze{
 
     std::vector<char> get_invalid_letters(std::string input_string){
         std::vector<char> ret;
+        bool char_in_str[256] = {false};
+
+        for(char word_char: input_string){
+            char_in_str[(uint8_t)word_char] = true;
+        }
         for(char curr_char = 'a'; curr_char <= 'z'; curr_char++){
-            bool char_in_str = false;
-            for(char word_char: input_string){
-                if(word_char == curr_char){
-                    char_in_str = true;
-                    break;
-                }
-            }
-            if(!char_in_str){
+            if(!char_in_str[(uint8_t)curr_char]){
                 ret.push_back(curr_char);
             }
         }
@@ -617,120 +1240,269 @@ struct WordMaze: public Maze{
     }
 
     void place_letter_in_exit_blocks(Block *block_with_exits, int word_index = -1){
-        std::vector<char> invalid_letters = get_invalid_letters(word);
-
         for(int direction = 0; direction < None; direction++){
             if(!(block_with_exits->is_exit_direction(GridDirection(direction)))) continue;
 
             Block *letter_block = map->get_block_in_direction(block_with_exits, GridDirection(direction), false);
 
-            if(!letter_block){
-                block_with_exits->remove_exit_direction(GridDirection(direction));
-                continue;
-            }
+            // Only the end block exits off the grid
+            if(!letter_block) continue;
 
-            if(solution_path->block_in_path(letter_block) && word_index != -1){
+            if(is_on_solution_path(letter_block) && word_index != -1){
                 letter_block->set_letter(word[word_index]);
             }else{
                 if(word_index != -1){
                     letter_block->set_letter(word[(word_index + 1) % word.length()]);
                 }else{
-                    int invalid_letter_choice = get_rand_int(0, invalid_letters.size() - 1);
-                    letter_block->set_letter(invalid_letters.at(invalid_letter_choice));
+                    int invalid_letter_choice = random.get_rand_int(0, decoy_letters.size() - 1);
+                    letter_block->set_letter(decoy_letters.at(invalid_letter_choice));
                 }
             }
         }
     }
 
-    Block** select_solution_path_junctions(std::vector<Block*> junctions){
-        Block **ret = (Block**) calloc(word.length(), sizeof(Block*));
-        std::vector<int> indexes_chosen;
-
-        while(indexes_chosen.size() < word.length()){
-            int random_index = get_rand_int(0, junctions.size() - 1);
-            bool index_already_selected = false;
+    /**
+     * @brief Pick one solution path junction per letter of the word. Closing the others cuts their
+     * branches off, and fill out can only grow those back from a block beside them, so every area
+     * the solution path walls off gets a picked junction beside it first where the word allows.
+     *
+     * @param junction_indexes Block indexes of every junction on the solution path
+     * @param areas Area of each block from get_walled_off_areas
+     * @param area_reached Filled in with whether each area is beside a picked junction or the end
+     * @return std::vector<bool> One bit per block, set for the junctions that were picked
+     */
+    std::vector<bool> select_solution_path_junctions(std::vector<int> &junction_indexes, std::vector<int> &areas, std::vector<bool> &area_reached){
+        std::vector<bool> junction_chosen(junction_indexes.size(), false);
+        std::vector<bool> selected(map->grid_width * map->grid_height, false);
+        size_t chosen_count = 0;
+
+        int area_count = 0;
+        for(int area: areas) area_count = std::max(area_count, area + 1);
+        std::vector<std::vector<int>> area_junctions(area_count);
+        area_reached.assign(area_count, false);
+
+        mark_areas_beside(map_end, areas, area_reached);
+        for(size_t junction_index = 0; junction_index < junction_indexes.size(); junction_index++){
+            for(int direction = 0; direction < None; direction++){
+                Block *neighbour = map->get_block_in_direction(&map->block_grid[junction_indexes[junction_index]], GridDirection(direction), false);
+                if(!neighbour) continue;
 
-            for(int chosen_index = 0; chosen_index < indexes_chosen.size(); chosen_index++){
-                if(indexes_chosen.at(chosen_index) == random_index) {
-                    index_already_selected = true;
-                    break;
-                }
+                int area = areas[map->get_block_index(neighbour)];
+                if(area != -1 && (area_junctions[area].empty() || area_junctions[area].back() != (int)junction_index)) area_junctions[area].push_back(junction_index);
             }
+        }
+
+        // Areas with the fewest junctions beside them first, they have the least choice
+        std::vector<int> area_order;
+        for(int area = 0; area < area_count; area++){
+            if(!area_reached[area] && !area_junctions[area].empty()) area_order.push_back(area);
+        }
+        std::stable_sort(area_order.begin(), area_order.end(), [&area_junctions](int first, int second){
+            return area_junctions[first].size() < area_junctions[second].size();
+        });
+
+        for(int area: area_order){
+            if(chosen_count >= word.length()) break;
+            if(area_reached[area]) continue;
+
+            int junction_index = area_junctions[area][random.get_rand_int(0, area_junctions[area].size() - 1)];
+            junction_chosen[junction_index] = true;
+            selected[junction_indexes[junction_index]] = true;
+            chosen_count++;
+            mark_areas_beside(&map->block_grid[junction_indexes[junction_index]], areas, area_reached);
+        }
 
-            if(index_already_selected) continue;
+        while(chosen_count < word.length() && chosen_count < junction_indexes.size()){
+            int random_index = random.get_rand_int(0, junction_indexes.size() - 1);
 
-            ret[indexes_chosen.size()] = junctions.at(random_index);
-            indexes_chosen.push_back(random_index);
+            if(junction_chosen[random_index]){
+                MAZE_COUNT(JunctionRetries, 1);
+                continue;
+            }
+
+            junction_chosen[random_index] = true;
+            selected[junction_indexes[random_index]] = true;
+            chosen_count++;
         }
 
-        return ret;
+        return selected;
     }
 
-    void close_all_solution_path_junctions(std::vector<Block*> &junctions, Block **excluded_junctions, int excluded_junctions_length){
-        for(Block *block: junctions){
-            bool valid_junction = true;
+    void mark_areas_beside(Block *block, std::vector<int> &areas, std::vector<bool> &area_reached){
+        for(int direction = 0; direction < None; direction++){
+            Block *neighbour = map->get_block_in_direction(block, GridDirection(direction), false);
+            if(neighbour && areas[map->get_block_index(neighbour)] != -1) area_reached[areas[map->get_block_index(neighbour)]] = true;
+        }
+    }
 
-            for(int exc_junc_index = 0; exc_junc_index < excluded_junctions_length; exc_junc_index++){
-                if(excluded_junctions[exc_junc_index] == block){
-                    valid_junction = false;
-                    break;
+    /**
+     * @brief Split the blocks off the solution path into the areas the path walls off from each other
+     *
+     * @return std::vector<int> Area of each block, -1 for blocks on the solution path
+     */
+    std::vector<int> get_walled_off_areas(){
+        int block_count = map->grid_width * map->grid_height;
+        std::vector<int> areas(block_count, -1), search_queue;
+        int area_count = 0;
+
+        for(int first_index = 0; first_index < block_count; first_index++){
+            if(on_solution_path[first_index] || areas[first_index] != -1) continue;
+
+            areas[first_index] = area_count;
+            search_queue.assign(1, first_index);
+            for(size_t queue_head = 0; queue_head < search_queue.size(); queue_head++){
+                Block *curr_block = &map->block_grid[search_queue[queue_head]];
+
+                for(int direction = 0; direction < None; direction++){
+                    Block *next_block = map->get_block_in_direction(curr_block, GridDirection(direction), false);
+                    if(!next_block) continue;
+
+                    int next_index = map->get_block_index(next_block);
+                    if(on_solution_path[next_index] || areas[next_index] != -1) continue;
+
+                    areas[next_index] = area_count;
+                    search_queue.push_back(next_index);
                 }
             }
+            area_count++;
+        }
+
+        return areas;
+    }
+
+    /**
+     * @brief Cut across every loop of the solution path, where it comes back beside itself, that
+     * goes past an area no picked junction reaches. The loop becomes a branch, which joins the area
+     * to the ones on the other side of the loop.
+     *
+     * @param areas Area of each block from get_walled_off_areas
+     * @param area_reached Whether each area is reached, from select_solution_path_junctions
+     * @return true At least one shortcut was made
+     */
+    bool shortcut_around_unreached_areas(std::vector<int> &areas, std::vector<bool> &area_reached){
+        int path_length = solution_path->curr_path_len;
+        std::vector<int> unreached_before(path_length + 1, 0);
+        bool shortcut = false;
+
+        // How many path blocks before each one are beside an unreached area
+        for(int path_index = 0; path_index < path_length; path_index++){
+            bool beside_unreached = false;
+            for(int direction = 0; direction < None; direction++){
+                Block *neighbour = map->get_block_in_direction(solution_path->path[path_index], GridDirection(direction), false);
+                int area = neighbour ? areas[map->get_block_index(neighbour)] : -1;
+                if(area != -1 && !area_reached[area]) beside_unreached = true;
+            }
+            unreached_before[path_index + 1] = unreached_before[path_index] + beside_unreached;
+        }
+
+        // Shortcuts that don't overlap leave each other's blocks in the same order on the path
+        for(int from_index = 0; from_index < path_length - 2; from_index++){
+            Block *from_block = solution_path->path[from_index];
+            int to_index = path_length;
+            GridDirection to_direction = None;
+
+            for(int direction = 0; direction < None; direction++){
+                Block *later_block = map->get_block_in_direction(from_block, GridDirection(direction), false);
+                if(!is_on_solution_path(later_block)) continue;
+
+                // The nearest later block beside this one, as long as the loop to it passes an unreached area
+                int later_index = get_distance_from_start(later_block);
+                if(later_index <= from_index + 1 || later_index >= to_index) continue;
+                if(unreached_before[later_index] == unreached_before[from_index + 1]) continue;
+
+                to_index = later_index;
+                to_direction = GridDirection(direction);
+            }
+            if(to_direction == None) continue;
+
+            reparent_block(solution_path->path[to_index], from_block, to_direction);
+            MAZE_COUNT(PathShortcuts, 1);
+            shortcut = true;
+            from_index = to_index - 1;
+        }
+
+        return shortcut;
+    }
+
+    /**
+     * @brief Pick the junctions for the word so that every area the solution path walls off is beside
+     * one of them or the end. A winding path can wall off more areas than the word has letters, then
+     * it's shortened around the ones left over, and rebuilt around a comb if that doesn't get there.
+     *
+     * @param junction_indexes Filled in with the junctions on the solution path
+     * @return std::vector<bool> One bit per block, set for the junctions that were picked
+     */
+    std::vector<bool> select_junctions_reaching_every_area(std::vector<int> &junction_indexes){
+        std::vector<bool> area_reached;
+
+        // Every pass shortens the path, unless making room for the word again lengthens it
+        for(int pass = 0; pass < map->grid_width + map->grid_height; pass++){
+            junction_indexes = get_solution_path_junctions();
+            if(junction_indexes.size() < word.length()) break;
+
+            std::vector<int> areas = get_walled_off_areas();
+            std::vector<bool> selected = select_solution_path_junctions(junction_indexes, areas, area_reached);
+            if(std::find(area_reached.begin(), area_reached.end(), false) == area_reached.end()) return selected;
+
+            if(!shortcut_around_unreached_areas(areas, area_reached)) break;
+            solve_maze();
+            if(get_solution_path_junctions().size() < word.length()) make_room_for_word();
+            if(Cancellation::is_cancelled() || !solution_path) break;
+        }
+
+        // Only the areas between the comb's rows need a junction, and it has more junctions than that
+        build_comb_solution_path();
+        solve_maze();
+        junction_indexes = get_solution_path_junctions();
+        std::vector<int> areas = get_walled_off_areas();
+        return select_solution_path_junctions(junction_indexes, areas, area_reached);
+    }
 
-            if(!valid_junction) continue;
+    void close_all_solution_path_junctions(std::vector<int> &junction_indexes, std::vector<bool> &selected_junctions){
+        for(int junction_index: junction_indexes){
+            if(selected_junctions[junction_index]) continue;
 
+            Block *block = &map->block_grid[junction_index];
             for(int direction = 0; direction < None; direction++){
                 if(!block->is_exit_direction(GridDirection(direction))) continue;
                 Block *next_block = map->get_block_in_direction(block, GridDirection(direction), false);
 
                 if(!next_block) continue;
 
-                if(!solution_path->block_in_path(next_block)){
+                if(!is_on_solution_path(next_block)){
                     close_and_unexplore_connected_blocks(next_block);
                 }
             }
         }
     }
 
-    std::vector<Block*> get_all_explored_path_end_blocks(){
-        std::vector<Block*> all_explored = map->get_all_explored_blocks();
-        std::vector<Block*> ret;
+    /**
+     * @brief Grow the branches cut off the solution path back in. Any explored block off the
+     * solution path can start a new branch, and so can the picked junctions and the end, other
+     * solution blocks can't or they would become junctions.
+     */
+    void fill_out_unexplored_areas(){
+        MAZE_PHASE("fill_out");
+        std::vector<Block*> roots;
+
+        for(int block_index = 0; block_index < map->grid_width * map->grid_height; block_index++){
+            Block *block = &map->block_grid[block_index];
+            if(!block->explored) continue;
 
-        for(Block *curr_block: all_explored){
-            if(curr_block->exit_count() > 0) continue;
-            ret.push_back(curr_block);
+            if(!on_solution_path[block_index] || block->is_mulit_exit() || block == map_end) roots.push_back(block);
         }
 
-        return ret;
+        MAZE_COUNT(FillOutRoots, roots.size());
+        carve_from_roots(roots);
+        map->clean_all_blocks();
     }
 
-    void fill_out_unexplored_areas(){
-        std::vector<std::pair<GridDirection,Block*>> unexplored_blocks_around;
-        std::vector<Block*> all_explored_ends = get_all_explored_path_end_blocks();
-        int new_end_count = all_explored_ends.size();
-        int past_end_count = -1;
-
-        while(past_end_count != new_end_count){
-            past_end_count = new_end_count;
-
-            for(Block *block: all_explored_ends){
-                unexplored_blocks_around = map->get_blocks_in_all_directions(block);
-
-                if(unexplored_blocks_around.size() > 0){
-                    std::pair<GridDirection, Block*> dir_to = unexplored_blocks_around.at(get_rand_int(0, unexplored_blocks_around.size() - 1));
-                    if(!block->is_exit_direction(dir_to.first)){
-                        block->add_exit_direction(dir_to.first);
-                        dir_to.second->set_entry_direction(get_opposite_direction(dir_to.first));
-                        generate_paths(dir_to.second);
-                    }
-                }
-            }
-
-            all_explored_ends = get_all_explored_path_end_blocks();
-            new_end_count = all_explored_ends.size();
+    int get_unexplored_block_count(){
+        int unexplored_count = 0;
+        for(int block_index = 0; block_index < map->grid_width * map->grid_height; block_index++){
+            if(!map->block_grid[block_index].explored) unexplored_count++;
         }
-
-        map->clean_all_blocks();
+        return unexplored_count;
     }
 
     void apply_letters_to_junctions(){
@@ -739,7 +1511,7 @@ struct WordMaze: public Maze{
         }
 
         int exit_num = 0;
-        for(int block_index = 0; block_index < solution_path->curr_path_len; block_index++){
+        for(int block_index = 0; block_index < solution_path->curr_path_len - 1; block_index++){
             Block *curr_block = solution_path->path[block_index];
             if(curr_block->exit_count() > 1){
                 place_letter_in_exit_blocks(curr_block, exit_num);
@@ -748,31 +1520,24 @@ struct WordMaze: public Maze{
         }
     }
 
-    std::vector<Block*> get_solution_path_junctions(){
-        std::vector<Block*> junctions = map->get_all_junctions();
-        std::vector<Block*> ret;
-
-        for(Block *start_block: junctions){
-            if(solution_path->block_in_path(start_block)){
-                ret.push_back(start_block);
-            }
-        }
-
-        return ret;
-    }
-
     void apply_word(){
-        int exit_count = word.length();
-        std::vector<Block*> solution_junctions = get_solution_path_junctions();
-
-        if(solution_junctions.size() < exit_count){
-            std::cout << "Not enough exits points to write word!" << std::endl;
-            return;
-        }
-        map->save_array_as_png("PreWordApply.png");
-        Block **selected_junctions = select_solution_path_junctions(solution_junctions);
-        close_all_solution_path_junctions(solution_junctions, selected_junctions, word.length());
+        MAZE_PHASE("apply_word");
+        size_t exit_count = word.length();
+        std::vector<int> solution_junctions = get_solution_path_junctions();
+
+        // make_room_for_word fits every word word_fits accepts, callers check longer ones before building
+        if(solution_junctions.size() < exit_count) return;
+        decoy_letters = get_invalid_letters(word);
+        // A word using every letter leaves no decoys, fall back to letters from the word itself
+        if(decoy_letters.empty()) decoy_letters.assign(word.begin(), word.end());
+
+        std::vector<bool> selected_junctions = select_junctions_reaching_every_area(solution_junctions);
+        if(Cancellation::is_cancelled()) return;
+        close_all_solution_path_junctions(solution_junctions, selected_junctions);
         fill_out_unexplored_areas();
+        if(Cancellation::is_cancelled()) return;
+
+        assert(get_unexplored_block_count() == 0);
         apply_letters_to_junctions();
     }
 };
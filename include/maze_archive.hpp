@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+#include "maze_format.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef MAZE_ARCHIVE_H
+#define MAZE_ARCHIVE_H
+
+namespace MazeFormat{
+#define MAZE_ARCHIVE_MAGIC "SMZA"
+#define MAZE_ARCHIVE_VERSION 1
+// Magic, version, entry count and where the index starts
+#define MAZE_ARCHIVE_HEADER_SIZE 20
+// Record offset, record size, word size and word offset
+#define MAZE_ARCHIVE_ENTRY_SIZE 24
+
+/**
+ * @brief Writes many stored mazes to one file that MazeArchive can map and look up by word.
+ * The file is a 20 byte header, the records one after another, then an index sorted by word
+ * and the words themselves. Records are written as they are added, only the index is kept in
+ * memory until close. Each word is stored once, so the index is strictly ascending.
+ */
+struct MazeArchiveWriter{
+    struct Entry{
+        std::string word;
+        uint64_t record_offset;
+        uint32_t record_size;
+    };
+
+    FILE *file;
+    uint64_t file_offset;
+    std::vector<Entry> entries;
+    std::set<std::string> added_words;
+    bool failed;
+
+    MazeArchiveWriter(): file(NULL), file_offset(0), failed(false){}
+
+    ~MazeArchiveWriter(){
+        if(file) fclose(file);
+    }
+
+    MazeArchiveWriter(const MazeArchiveWriter&) = delete;
+    MazeArchiveWriter& operator=(const MazeArchiveWriter&) = delete;
+
+    bool open(std::string filename){
+        file = fopen(filename.c_str(), "wb");
+        if(!file) return false;
+
+        // The header is written again with the index offset by close
+        std::vector<uint8_t> header(MAZE_ARCHIVE_HEADER_SIZE, 0);
+        failed = fwrite(header.data(), 1, header.size(), file) != header.size();
+        file_offset = header.size();
+
+        return !failed;
+    }
+
+    /**
+     * @brief Write a maze to the archive, a word already added keeps its first maze and this one is dropped
+     */
+    void add(std::string word, const std::vector<uint8_t> &record){
+        if(!file || failed) return;
+        if(!added_words.insert(word).second) return;
+
+        Entry entry;
+        entry.word = word;
+        entry.record_offset = file_offset;
+        entry.record_size = record.size();
+        entries.push_back(entry);
+
+        failed = fwrite(record.data(), 1, record.size(), file) != record.size();
+        file_offset += record.size();
+    }
+
+    /**
+     * @brief Write the index and finish the file
+     *
+     * @return true Everything added made it to the file
+     * @return false A write failed, the file is incomplete
+     */
+    bool close(){
+        if(!file) return false;
+
+        std::sort(entries.begin(), entries.end(), [](const Entry &first, const Entry &second){
+            return first.word < second.word;
+        });
+
+        std::vector<uint8_t> index;
+        uint64_t word_offset = file_offset + entries.size() * MAZE_ARCHIVE_ENTRY_SIZE;
+        index.reserve(entries.size() * MAZE_ARCHIVE_ENTRY_SIZE);
+        for(Entry &entry: entries){
+            append_uint64(index, entry.record_offset);
+            append_uint32(index, entry.record_size);
+            append_uint32(index, entry.word.size());
+            append_uint64(index, word_offset);
+            word_offset += entry.word.size();
+        }
+        for(Entry &entry: entries){
+            index.insert(index.end(), entry.word.begin(), entry.word.end());
+        }
+
+        std::vector<uint8_t> header;
+        header.insert(header.end(), MAZE_ARCHIVE_MAGIC, MAZE_ARCHIVE_MAGIC + 4);
+        append_uint16(header, MAZE_ARCHIVE_VERSION);
+        append_uint16(header, 0);
+        append_uint32(header, entries.size());
+        append_uint64(header, file_offset);
+
+        if(!failed) failed = fwrite(index.data(), 1, index.size(), file) != index.size();
+        if(!failed) failed = fseek(file, 0, SEEK_SET) != 0 || fwrite(header.data(), 1, header.size(), file) != header.size();
+        if(fclose(file) != 0) failed = true;
+        file = NULL;
+
+        return !failed;
+    }
+};
+
+/**
+ * @brief A file of stored mazes mapped into memory, looking a maze up by word is a binary search
+ * over the index and reading it copies nothing. Every offset is checked when the file is opened.
+ */
+struct MazeArchive{
+    const uint8_t *data;
+    size_t size;
+    uint32_t entry_count;
+    const uint8_t *index;
+#ifdef _WIN32
+    HANDLE file_handle, mapping_handle;
+#endif
+
+    MazeArchive(): data(NULL), size(0), entry_count(0), index(NULL){
+#ifdef _WIN32
+        file_handle = INVALID_HANDLE_VALUE;
+        mapping_handle = NULL;
+#endif
+    }
+
+    ~MazeArchive(){
+        close();
+    }
+
+    MazeArchive(const MazeArchive&) = delete;
+    MazeArchive& operator=(const MazeArchive&) = delete;
+
+    /**
+     * @brief Map an archive written by MazeArchiveWriter
+     *
+     * @return true The archive is open
+     * @return false The file couldn't be mapped or isn't a complete archive
+     */
+    bool open(std::string filename){
+        close();
+
+#ifdef _WIN32
+        LARGE_INTEGER file_size;
+
+        file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file_handle == INVALID_HANDLE_VALUE) return false;
+        if(!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart < MAZE_ARCHIVE_HEADER_SIZE){
+            close();
+            return false;
+        }
+
+        mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping_handle) data = (const uint8_t*) MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if(!data){
+            close();
+            return false;
+        }
+        size = file_size.QuadPart;
+#else
+        struct stat file_stat;
+        int file_descriptor = ::open(filename.c_str(), O_RDONLY);
+        if(file_descriptor == -1) return false;
+
+        if(fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size < MAZE_ARCHIVE_HEADER_SIZE){
+            ::close(file_descriptor);
+            return false;
+        }
+
+        void *mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        // The mapping keeps the file open on its own
+        ::close(file_descriptor);
+        if(mapping == MAP_FAILED) return false;
+
+        data = (const uint8_t*) mapping;
+        size = file_stat.st_size;
+#endif
+
+        if(!check_index()){
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void close(){
+#ifdef _WIN32
+        if(data) UnmapViewOfFile(data);
+        if(mapping_handle) CloseHandle(mapping_handle);
+        if(file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+        file_handle = INVALID_HANDLE_VALUE;
+        mapping_handle = NULL;
+#else
+        if(data) munmap((void*) data, size);
+#endif
+        data = NULL;
+        size = 0;
+        entry_count = 0;
+        index = NULL;
+    }
+
+    bool is_open(){
+        return data != NULL;
+    }
+
+    int get_entry_count(){
+        return entry_count;
+    }
+
+    std::string get_word(int entry){
+        const uint8_t *entry_data = index + (size_t)entry * MAZE_ARCHIVE_ENTRY_SIZE;
+        return std::string((const char*) data + read_uint64(entry_data + 16), read_uint32(entry_data + 12));
+    }
+
+    /**
+     * @brief Get the stored maze of an entry, pointing into the mapped file
+     *
+     * @param entry The entry, from 0 to get_entry_count() - 1
+     * @param record_size Set to the bytes in the record
+     * @return const uint8_t* The record, valid until the archive is closed
+     */
+    const uint8_t* get_record(int entry, size_t &record_size){
+        const uint8_t *entry_data = index + (size_t)entry * MAZE_ARCHIVE_ENTRY_SIZE;
+        record_size = read_uint32(entry_data + 8);
+        return data + read_uint64(entry_data);
+    }
+
+    /**
+     * @brief Find the entry for a word
+     *
+     * @return int The word's entry, -1 if there isn't one
+     */
+    int find(std::string word){
+        int low = 0, high = entry_count;
+
+        while(low < high){
+            int middle = low + (high - low) / 2;
+            const uint8_t *entry_data = index + (size_t)middle * MAZE_ARCHIVE_ENTRY_SIZE;
+            std::string middle_word((const char*) data + read_uint64(entry_data + 16), read_uint32(entry_data + 12));
+
+            if(middle_word < word) low = middle + 1;
+            else high = middle;
+        }
+
+        if(low < (int)entry_count && get_word(low) == word) return low;
+        return -1;
+    }
+
+private:
+    bool check_index(){
+        if(memcmp(data, MAZE_ARCHIVE_MAGIC, 4) != 0 || read_uint16(data + 4) != MAZE_ARCHIVE_VERSION) return false;
+
+        uint64_t index_offset = read_uint64(data + 12);
+        entry_count = read_uint32(data + 8);
+        if(index_offset < MAZE_ARCHIVE_HEADER_SIZE || index_offset > size || (size - index_offset) / MAZE_ARCHIVE_ENTRY_SIZE < entry_count) return false;
+        index = data + index_offset;
+
+        for(uint32_t entry = 0; entry < entry_count; entry++){
+            const uint8_t *entry_data = index + (size_t)entry * MAZE_ARCHIVE_ENTRY_SIZE;
+            uint64_t record_offset = read_uint64(entry_data), record_size = read_uint32(entry_data + 8);
+            uint64_t word_offset = read_uint64(entry_data + 16), word_size = read_uint32(entry_data + 12);
+
+            if(record_offset > size || record_size > size - record_offset) return false;
+            if(word_offset > size || word_size > size - word_offset) return false;
+
+            // find is a binary search, which only works if every word comes after the one before it
+            if(entry > 0){
+                const uint8_t *previous_data = entry_data - MAZE_ARCHIVE_ENTRY_SIZE;
+                uint64_t previous_offset = read_uint64(previous_data + 16), previous_size = read_uint32(previous_data + 12);
+                int order = memcmp(data + previous_offset, data + word_offset, std::min(previous_size, word_size));
+
+                if(order > 0 || (order == 0 && previous_size >= word_size)) return false;
+            }
+        }
+
+        return true;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "utils.hpp"
+#include "generators.hpp"
+#include "instrumentation.hpp"
+
+#ifndef MAZE_FORMAT_H
+#define MAZE_FORMAT_H
+
+namespace MazeFormat{
+#define MAZE_RECORD_MAGIC "SMZR"
+#define MAZE_RECORD_VERSION 1
+// Magic, version, generator, word length, grid size, seed, start, end, solution length and letter count
+#define MAZE_RECORD_HEADER_SIZE 40
+// Largest grid side a record holds, encode and decode both turn away anything larger
+#define MAZE_RECORD_MAX_GRID_SIZE 0xFFFF
+
+/**
+ * @brief A maze as it is stored, enough to draw it again without generating it. Only the open
+ * sides of each block are kept, the maze is a tree so walking it out from the start gives back
+ * every entry and exit.
+ *
+ * Stored little endian as a 40 byte header and the word, then 4 bits of open sides per block,
+ * 1 bit per block saying it has a letter, 1 byte per lettered block and 2 bits per solution step.
+ */
+struct MazeRecord{
+    int grid_width, grid_height;
+    uint64_t seed;
+    uint8_t generator_type;
+    // Kept to its first 65535 characters, far more than any grid can spell out
+    std::string word;
+    // Open sides of every block as a direction mask, including the start's entry and the end's exit
+    std::vector<uint8_t> open_masks;
+    // Letter of every block, 0 for none
+    std::vector<char> letters;
+    int start_index, end_index;
+    // Direction of each step along the solution from the start, no solution has no blocks at all
+    std::vector<uint8_t> solution_steps;
+    bool has_solution;
+
+    // Filled in by decode, the direction each block is entered from (None for the start and for
+    // blocks the start can't reach) and how many steps each block is from the start
+    std::vector<uint8_t> entry_directions;
+    std::vector<int> distance_from_start;
+
+    MazeRecord(): grid_width(0), grid_height(0), seed(0), generator_type(0), start_index(0), end_index(0), has_solution(false){}
+
+    size_t get_block_count() const{
+        return (size_t)grid_width * grid_height;
+    }
+
+    /**
+     * @brief Get the block a step leads to
+     *
+     * @return int The block index, -1 if the step leaves the grid
+     */
+    int get_neighbour(int x, int y, GridDirection direction) const{
+        if(direction == North) y--;
+        if(direction == South) y++;
+        if(direction == West) x--;
+        if(direction == East) x++;
+
+        if(x < 0 || y < 0 || x >= grid_width || y >= grid_height) return -1;
+        return y * grid_width + x;
+    }
+
+    int get_neighbour(int block_index, GridDirection direction) const{
+        return get_neighbour(block_index % grid_width, block_index / grid_width, direction);
+    }
+};
+
+// Little endian, unlike the big endian integers PNG chunks use
+void append_uint16(std::vector<uint8_t> &out, uint16_t value){
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+void append_uint32(std::vector<uint8_t> &out, uint32_t value){
+    append_uint16(out, value & 0xFFFF);
+    append_uint16(out, value >> 16);
+}
+
+void append_uint64(std::vector<uint8_t> &out, uint64_t value){
+    append_uint32(out, value & 0xFFFFFFFF);
+    append_uint32(out, value >> 32);
+}
+
+uint16_t read_uint16(const uint8_t *data){
+    return data[0] | (data[1] << 8);
+}
+
+uint32_t read_uint32(const uint8_t *data){
+    return read_uint16(data) | ((uint32_t)read_uint16(data + 2) << 16);
+}
+
+uint64_t read_uint64(const uint8_t *data){
+    return read_uint32(data) | ((uint64_t)read_uint32(data + 4) << 32);
+}
+
+/**
+ * @brief Pack a maze into its stored form
+ *
+ * @throws std::length_error The grid is larger than decode accepts, so the record couldn't be read back
+ */
+std::vector<uint8_t> encode(const MazeRecord &record){
+    MAZE_PHASE("encode_record");
+    size_t block_count = record.get_block_count();
+
+    if(record.grid_width < 1 || record.grid_height < 1 || record.grid_width > MAZE_RECORD_MAX_GRID_SIZE || record.grid_height > MAZE_RECORD_MAX_GRID_SIZE || block_count > INT_MAX){
+        throw std::length_error("A " + std::to_string(record.grid_width) + "x" + std::to_string(record.grid_height) + " maze is too large to store");
+    }
+    uint32_t letter_count = 0;
+    std::vector<uint8_t> out;
+
+    for(char letter: record.letters){
+        if(letter != 0) letter_count++;
+    }
+
+    out.reserve(MAZE_RECORD_HEADER_SIZE + record.word.size() + block_count / 2 + block_count / 8 + letter_count + record.solution_steps.size() / 4 + 3);
+    out.insert(out.end(), MAZE_RECORD_MAGIC, MAZE_RECORD_MAGIC + 4);
+    out.push_back(MAZE_RECORD_VERSION);
+    out.push_back(record.generator_type);
+    append_uint16(out, std::min<size_t>(record.word.size(), 0xFFFF));
+    append_uint32(out, record.grid_width);
+    append_uint32(out, record.grid_height);
+    append_uint64(out, record.seed);
+    append_uint32(out, record.start_index);
+    append_uint32(out, record.end_index);
+    append_uint32(out, record.has_solution ? record.solution_steps.size() + 1 : 0);
+    append_uint32(out, letter_count);
+    out.insert(out.end(), record.word.begin(), record.word.begin() + std::min<size_t>(record.word.size(), 0xFFFF));
+
+    for(size_t block_index = 0; block_index < block_count; block_index += 2){
+        uint8_t packed = record.open_masks[block_index] & ALL_DIRECTIONS_MASK;
+        if(block_index + 1 < block_count) packed |= (record.open_masks[block_index + 1] & ALL_DIRECTIONS_MASK) << 4;
+        out.push_back(packed);
+    }
+
+    size_t bitmap_start = out.size();
+    out.resize(bitmap_start + (block_count + 7) / 8, 0);
+    for(size_t block_index = 0; block_index < block_count; block_index++){
+        if(record.letters[block_index] != 0) out[bitmap_start + block_index / 8] |= 1 << (block_index % 8);
+    }
+    for(char letter: record.letters){
+        if(letter != 0) out.push_back(letter);
+    }
+
+    size_t steps_start = out.size();
+    out.resize(steps_start + (record.solution_steps.size() + 3) / 4, 0);
+    for(size_t step_index = 0; step_index < record.solution_steps.size(); step_index++){
+        out[steps_start + step_index / 4] |= (record.solution_steps[step_index] & 3) << ((step_index % 4) * 2);
+    }
+
+    return out;
+}
+
+/**
+ * @brief Walk the maze out from the start, filling in entry_directions and distance_from_start.
+ * Fails unless every open side is matched by the neighbour's, nothing leaves the grid apart from
+ * the start's entry to the north and the end's exit to the south, there are no loops and the
+ * solution steps only follow open sides from the start to the end.
+ */
+bool orient(MazeRecord &record){
+    size_t block_count = record.get_block_count();
+    std::vector<int> search_queue;
+
+    record.entry_directions.assign(block_count, None);
+    record.distance_from_start.assign(block_count, -1);
+
+    // Each block's east and south sides have to match the west and north sides of the blocks
+    // beyond them, and nothing opens off the grid apart from the start's entry and end's exit
+    for(int y = 0; y < record.grid_height; y++){
+        for(int x = 0; x < record.grid_width; x++){
+            int block_index = y * record.grid_width + x;
+            uint8_t open_mask = record.open_masks[block_index];
+            bool east_open = x + 1 < record.grid_width && record.open_masks[block_index + 1] & direction_bit(West);
+            bool south_open = y + 1 < record.grid_height && record.open_masks[block_index + record.grid_width] & direction_bit(North);
+
+            if(bool(open_mask & direction_bit(East)) != east_open) return false;
+            if(y + 1 < record.grid_height || block_index != record.end_index){
+                if(bool(open_mask & direction_bit(South)) != south_open) return false;
+            }
+            if(x == 0 && open_mask & direction_bit(West)) return false;
+            if(y == 0 && block_index != record.start_index && open_mask & direction_bit(North)) return false;
+        }
+    }
+
+    if(record.open_masks[record.start_index] & direction_bit(North)) record.entry_directions[record.start_index] = North;
+    record.distance_from_start[record.start_index] = 0;
+    search_queue.reserve(block_count);
+    search_queue.push_back(record.start_index);
+
+    for(size_t queue_head = 0; queue_head < search_queue.size(); queue_head++){
+        int curr_index = search_queue[queue_head];
+        int x = curr_index % record.grid_width, y = curr_index / record.grid_width;
+
+        for(int direction = 0; direction < None; direction++){
+            if(direction == record.entry_directions[curr_index]) continue;
+            if(!(record.open_masks[curr_index] & direction_bit(GridDirection(direction)))) continue;
+
+            int next_index = record.get_neighbour(x, y, GridDirection(direction));
+            if(next_index == -1) continue;
+
+            // Reaching a block twice means the passages loop
+            if(record.distance_from_start[next_index] != -1) return false;
+
+            record.entry_directions[next_index] = get_opposite_direction(GridDirection(direction));
+            record.distance_from_start[next_index] = record.distance_from_start[curr_index] + 1;
+            search_queue.push_back(next_index);
+        }
+    }
+
+    // Open sides on blocks the start can't reach would be passages nothing leads to
+    for(size_t block_index = 0; block_index < block_count; block_index++){
+        if(record.distance_from_start[block_index] == -1 && record.open_masks[block_index] != 0) return false;
+    }
+
+    if(!record.has_solution) return true;
+
+    int curr_index = record.start_index;
+    for(uint8_t step: record.solution_steps){
+        int next_index = record.get_neighbour(curr_index, GridDirection(step));
+        if(next_index == -1 || record.entry_directions[next_index] != get_opposite_direction(GridDirection(step))) return false;
+        curr_index = next_index;
+    }
+
+    return curr_index == record.end_index;
+}
+
+/**
+ * @brief Unpack a stored maze, checking it describes a maze that can be drawn
+ *
+ * @param data The stored maze
+ * @param size Bytes in data
+ * @param record Set to the maze
+ * @return true The maze was read
+ * @return false The data is truncated, from another version or isn't a valid maze
+ */
+bool decode(const uint8_t *data, size_t size, MazeRecord &record){
+    MAZE_PHASE("decode_record");
+    if(size < MAZE_RECORD_HEADER_SIZE || memcmp(data, MAZE_RECORD_MAGIC, 4) != 0 || data[4] != MAZE_RECORD_VERSION) return false;
+
+    uint64_t grid_width = read_uint32(data + 8), grid_height = read_uint32(data + 12);
+    uint64_t start_index = read_uint32(data + 24), end_index = read_uint32(data + 28);
+    uint64_t solution_length = read_uint32(data + 32), letter_count = read_uint32(data + 36);
+    uint64_t word_length = read_uint16(data + 6);
+
+    if(data[5] > Kruskal) return false;
+    if(grid_width < 1 || grid_height < 1 || grid_width > MAZE_RECORD_MAX_GRID_SIZE || grid_height > MAZE_RECORD_MAX_GRID_SIZE) return false;
+
+    uint64_t block_count = grid_width * grid_height;
+    // Blocks are indexed with an int once loaded, so a grid with more can't be drawn or walked
+    if(block_count > INT_MAX) return false;
+    uint64_t step_count = solution_length > 0 ? solution_length - 1 : 0;
+    if(start_index >= block_count || end_index >= block_count || solution_length > block_count || letter_count > block_count) return false;
+
+    // Everything is sized from the header, so check it all fits before allocating any of it
+    uint64_t walls_offset = MAZE_RECORD_HEADER_SIZE + word_length;
+    uint64_t bitmap_offset = walls_offset + (block_count + 1) / 2;
+    uint64_t letters_offset = bitmap_offset + (block_count + 7) / 8;
+    uint64_t steps_offset = letters_offset + letter_count;
+    if(steps_offset + (step_count + 3) / 4 != size) return false;
+
+    record.grid_width = grid_width;
+    record.grid_height = grid_height;
+    record.seed = read_uint64(data + 16);
+    record.generator_type = data[5];
+    record.word.assign((const char*) data + MAZE_RECORD_HEADER_SIZE, word_length);
+    record.start_index = start_index;
+    record.end_index = end_index;
+    record.has_solution = solution_length > 0;
+
+    record.open_masks.resize(block_count);
+    for(uint64_t block_index = 0; block_index < block_count; block_index++){
+        record.open_masks[block_index] = (data[walls_offset + block_index / 2] >> ((block_index % 2) * 4)) & ALL_DIRECTIONS_MASK;
+    }
+
+    record.letters.assign(block_count, 0);
+    uint64_t letter_index = 0;
+    for(uint64_t block_index = 0; block_index < block_count; block_index++){
+        if(!(data[bitmap_offset + block_index / 8] & (1 << (block_index % 8)))) continue;
+
+        if(letter_index >= letter_count) return false;
+        record.letters[block_index] = data[letters_offset + letter_index++];
+    }
+    if(letter_index != letter_count) return false;
+
+    record.solution_steps.resize(step_count);
+    for(uint64_t step_index = 0; step_index < step_count; step_index++){
+        record.solution_steps[step_index] = (data[steps_offset + step_index / 4] >> ((step_index % 4) * 2)) & 3;
+    }
+
+    return orient(record);
+}
+}
+
+#endif
@@ -0,0 +1,347 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// SSE2 is always there on x86-64, AVX2 and SSSE3 are checked for when the first kernel runs
+#if !defined(SPELLING_MAZE_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#if defined(PIXEL_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_KERNELS_TARGET(instruction_set) __attribute__((target(instruction_set)))
+#else
+#define PIXEL_KERNELS_TARGET(instruction_set)
+#endif
+
+// Palettes up to this many colours are matched with vector compares, larger ones need a lookup
+#define PIXEL_KERNELS_MAX_VECTOR_PALETTE 16
+
+/**
+ * @brief The pixel loops drawing and encoding spend their time in, each with an AVX2, SSE2 and
+ * plain version picked by what the CPU running it supports. Every version writes exactly the same
+ * bytes. Pixels are 8 bit RGBA, passed around packed into a uint32_t in memory order.
+ */
+namespace PixelKernels{
+enum InstructionSet{
+    Scalar = 0,
+    SSE2,
+    SSSE3,
+    AVX2
+};
+
+#ifdef PIXEL_KERNELS_X86
+InstructionSet detect_instruction_set(){
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    bool has_ssse3 = info[2] & (1 << 9);
+    // AVX registers are only usable if the OS saves them, which it says through OSXSAVE and XCR0
+    bool os_saves_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    bool has_avx2 = false;
+    if(max_leaf >= 7 && os_saves_avx){
+        __cpuidex(info, 7, 0);
+        has_avx2 = info[1] & (1 << 5);
+    }
+#else
+    __builtin_cpu_init();
+    bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    if(has_avx2) return AVX2;
+    if(has_ssse3) return SSSE3;
+    return SSE2;
+}
+#else
+InstructionSet detect_instruction_set(){
+    return Scalar;
+}
+#endif
+
+/**
+ * @brief The best instruction set this CPU has, detected once
+ */
+InstructionSet get_instruction_set(){
+    static const InstructionSet instruction_set = detect_instruction_set();
+    return instruction_set;
+}
+
+const char* get_instruction_set_name(){
+    static const char *names[] = {"scalar", "sse2", "ssse3", "avx2"};
+    return names[get_instruction_set()];
+}
+
+uint32_t pack_pixel(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255){
+    uint8_t channels[4] = {r, g, b, a};
+    uint32_t pixel;
+
+    memcpy(&pixel, channels, 4);
+    return pixel;
+}
+
+/**
+ * @brief Write a run of one pixel
+ *
+ * @param dest Where the run starts
+ * @param pixel The pixel, from pack_pixel
+ * @param count Pixels in the run
+ */
+void fill_pixels_scalar(uint8_t *dest, uint32_t pixel, size_t count){
+    for(size_t index = 0; index < count; index++){
+        memcpy(dest + (index * 4), &pixel, 4);
+    }
+}
+
+/**
+ * @brief Write one pixel down a column, every row_stride bytes. A column is one store per row
+ * whichever instructions are used, so there is only the one version.
+ */
+void fill_column(uint8_t *dest, size_t row_stride, uint32_t pixel, size_t count){
+    for(size_t index = 0; index < count; index++){
+        memcpy(dest + (index * row_stride), &pixel, 4);
+    }
+}
+
+/**
+ * @brief Drop the alpha from RGBA pixels, writing them packed as RGB
+ */
+void rgba_to_rgb_scalar(const uint8_t *source, uint8_t *dest, size_t count){
+    for(size_t index = 0; index < count; index++){
+        dest[(index * 3)] = source[(index * 4)];
+        dest[(index * 3) + 1] = source[(index * 4) + 1];
+        dest[(index * 3) + 2] = source[(index * 4) + 2];
+    }
+}
+
+/**
+ * @brief Find each pixel's colour in a palette, ignoring alpha
+ *
+ * @param source count RGBA pixels
+ * @param palette Palette colours from pack_pixel with an alpha of 0
+ * @param palette_size Colours in the palette, at most PIXEL_KERNELS_MAX_VECTOR_PALETTE
+ * @param indexes Set to each pixel's palette index, 0 for colours not in the palette
+ */
+void palette_indexes_scalar(const uint8_t *source, size_t count, const uint32_t *palette, int palette_size, uint8_t *indexes){
+    uint32_t last_color = 0;
+    uint8_t last_index = 0;
+    bool have_last_color = false;
+
+    for(size_t index = 0; index < count; index++){
+        uint32_t color;
+        memcpy(&color, source + (index * 4), 4);
+        color &= pack_pixel(255, 255, 255, 0);
+
+        // Maze images are long runs of one colour, skip the search for those
+        if(!have_last_color || color != last_color){
+            last_color = color;
+            last_index = 0;
+            have_last_color = true;
+            for(int palette_index = 0; palette_index < palette_size; palette_index++){
+                if(palette[palette_index] == color) last_index = palette_index;
+            }
+        }
+        indexes[index] = last_index;
+    }
+}
+
+template<int bit_depth>
+void pack_samples_at_depth(const uint8_t *samples, size_t count, uint8_t *row){
+    const int samples_per_byte = 8 / bit_depth;
+
+    for(size_t byte_index = 0; byte_index * samples_per_byte < count; byte_index++){
+        size_t first_sample = byte_index * samples_per_byte;
+        uint8_t packed = 0;
+
+        for(int sample = 0; sample < samples_per_byte; sample++){
+            packed <<= bit_depth;
+            if(first_sample + sample < count) packed |= samples[first_sample + sample];
+        }
+        row[byte_index] = packed;
+    }
+}
+
+/**
+ * @brief Pack samples of 1, 2 or 4 bits into bytes the way PNG scanlines hold them, the first
+ * sample in the most significant bits and the last byte padded with zeros
+ *
+ * @param samples count samples, each below 1 << bit_depth
+ * @param row (count * bit_depth + 7) / 8 bytes to write
+ */
+void pack_samples_scalar(const uint8_t *samples, size_t count, int bit_depth, uint8_t *row){
+    if(bit_depth == 1) pack_samples_at_depth<1>(samples, count, row);
+    if(bit_depth == 2) pack_samples_at_depth<2>(samples, count, row);
+    if(bit_depth == 4) pack_samples_at_depth<4>(samples, count, row);
+}
+
+#ifdef PIXEL_KERNELS_X86
+void fill_pixels_sse2(uint8_t *dest, uint32_t pixel, size_t count){
+    __m128i value = _mm_set1_epi32(pixel);
+    size_t index = 0;
+
+    for(; index + 4 <= count; index += 4){
+        _mm_storeu_si128((__m128i*)(dest + (index * 4)), value);
+    }
+    fill_pixels_scalar(dest + (index * 4), pixel, count - index);
+}
+
+PIXEL_KERNELS_TARGET("avx2") void fill_pixels_avx2(uint8_t *dest, uint32_t pixel, size_t count){
+    __m256i value = _mm256_set1_epi32(pixel);
+    size_t index = 0;
+
+    for(; index + 8 <= count; index += 8){
+        _mm256_storeu_si256((__m256i*)(dest + (index * 4)), value);
+    }
+    fill_pixels_sse2(dest + (index * 4), pixel, count - index);
+}
+
+// Gathers the RGB of 4 pixels into the low 12 bytes
+#define PIXEL_KERNELS_RGB_SHUFFLE 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+PIXEL_KERNELS_TARGET("ssse3") void rgba_to_rgb_ssse3(const uint8_t *source, uint8_t *dest, size_t count){
+    __m128i shuffle = _mm_setr_epi8(PIXEL_KERNELS_RGB_SHUFFLE);
+    size_t index = 0;
+
+    // Each store writes 16 bytes for 12 of output, so stop while there are still 4 bytes after it
+    for(; index + 6 <= count; index += 4){
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(source + (index * 4)));
+        _mm_storeu_si128((__m128i*)(dest + (index * 3)), _mm_shuffle_epi8(pixels, shuffle));
+    }
+    rgba_to_rgb_scalar(source + (index * 4), dest + (index * 3), count - index);
+}
+
+PIXEL_KERNELS_TARGET("avx2") void rgba_to_rgb_avx2(const uint8_t *source, uint8_t *dest, size_t count){
+    __m256i shuffle = _mm256_setr_epi8(PIXEL_KERNELS_RGB_SHUFFLE, PIXEL_KERNELS_RGB_SHUFFLE);
+    size_t index = 0;
+
+    // The high half is stored over the 4 spare bytes the low half wrote
+    for(; index + 10 <= count; index += 8){
+        __m256i pixels = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(source + (index * 4))), shuffle);
+        _mm_storeu_si128((__m128i*)(dest + (index * 3)), _mm256_castsi256_si128(pixels));
+        _mm_storeu_si128((__m128i*)(dest + (index * 3) + 12), _mm256_extracti128_si256(pixels, 1));
+    }
+    rgba_to_rgb_ssse3(source + (index * 4), dest + (index * 3), count - index);
+}
+
+void palette_indexes_sse2(const uint8_t *source, size_t count, const uint32_t *palette, int palette_size, uint8_t *indexes){
+    __m128i color_mask = _mm_set1_epi32(pack_pixel(255, 255, 255, 0));
+    size_t index = 0;
+
+    for(; index + 4 <= count; index += 4){
+        __m128i colors = _mm_and_si128(_mm_loadu_si128((const __m128i*)(source + (index * 4))), color_mask);
+        __m128i found = _mm_setzero_si128();
+
+        for(int palette_index = 1; palette_index < palette_size; palette_index++){
+            __m128i matches = _mm_cmpeq_epi32(colors, _mm_set1_epi32(palette[palette_index]));
+            found = _mm_or_si128(found, _mm_and_si128(matches, _mm_set1_epi32(palette_index)));
+        }
+
+        found = _mm_packus_epi16(_mm_packs_epi32(found, found), found);
+        uint32_t packed = _mm_cvtsi128_si32(found);
+        memcpy(indexes + index, &packed, 4);
+    }
+    palette_indexes_scalar(source + (index * 4), count - index, palette, palette_size, indexes + index);
+}
+
+// Reverses each run of 8 bytes, so a byte mask comes out with the first sample in the top bit
+#define PIXEL_KERNELS_BIT_ORDER_SHUFFLE 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+
+// One bit samples are moved to the top of their byte and collected with a byte mask, deeper ones are left to the plain loop
+PIXEL_KERNELS_TARGET("ssse3") void pack_samples_ssse3(const uint8_t *samples, size_t count, int bit_depth, uint8_t *row){
+    __m128i bit_order = _mm_setr_epi8(PIXEL_KERNELS_BIT_ORDER_SHUFFLE);
+    size_t index = 0;
+
+    if(bit_depth != 1) return pack_samples_scalar(samples, count, bit_depth, row);
+
+    for(; index + 16 <= count; index += 16){
+        __m128i bits = _mm_slli_epi16(_mm_loadu_si128((const __m128i*)(samples + index)), 7);
+        uint16_t packed = _mm_movemask_epi8(_mm_shuffle_epi8(bits, bit_order));
+        memcpy(row + (index / 8), &packed, 2);
+    }
+    pack_samples_scalar(samples + index, count - index, bit_depth, row + (index / 8));
+}
+
+PIXEL_KERNELS_TARGET("avx2") void pack_samples_avx2(const uint8_t *samples, size_t count, int bit_depth, uint8_t *row){
+    __m256i bit_order = _mm256_setr_epi8(PIXEL_KERNELS_BIT_ORDER_SHUFFLE, PIXEL_KERNELS_BIT_ORDER_SHUFFLE);
+    size_t index = 0;
+
+    if(bit_depth != 1) return pack_samples_scalar(samples, count, bit_depth, row);
+
+    for(; index + 32 <= count; index += 32){
+        __m256i bits = _mm256_slli_epi16(_mm256_loadu_si256((const __m256i*)(samples + index)), 7);
+        uint32_t packed = _mm256_movemask_epi8(_mm256_shuffle_epi8(bits, bit_order));
+        memcpy(row + (index / 8), &packed, 4);
+    }
+    pack_samples_ssse3(samples + index, count - index, bit_depth, row + (index / 8));
+}
+
+PIXEL_KERNELS_TARGET("avx2") void palette_indexes_avx2(const uint8_t *source, size_t count, const uint32_t *palette, int palette_size, uint8_t *indexes){
+    __m256i color_mask = _mm256_set1_epi32(pack_pixel(255, 255, 255, 0));
+    // Takes the low byte of each 32 bit index into the low 4 bytes of each half
+    __m256i gather = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    size_t index = 0;
+
+    for(; index + 8 <= count; index += 8){
+        __m256i colors = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(source + (index * 4))), color_mask);
+        __m256i found = _mm256_setzero_si256();
+
+        for(int palette_index = 1; palette_index < palette_size; palette_index++){
+            __m256i matches = _mm256_cmpeq_epi32(colors, _mm256_set1_epi32(palette[palette_index]));
+            found = _mm256_or_si256(found, _mm256_and_si256(matches, _mm256_set1_epi32(palette_index)));
+        }
+
+        found = _mm256_shuffle_epi8(found, gather);
+        uint32_t low = _mm_cvtsi128_si32(_mm256_castsi256_si128(found));
+        uint32_t high = _mm_cvtsi128_si32(_mm256_extracti128_si256(found, 1));
+        memcpy(indexes + index, &low, 4);
+        memcpy(indexes + index + 4, &high, 4);
+    }
+    palette_indexes_sse2(source + (index * 4), count - index, palette, palette_size, indexes + index);
+}
+#endif
+
+void fill_pixels(uint8_t *dest, uint32_t pixel, size_t count){
+#ifdef PIXEL_KERNELS_X86
+    if(get_instruction_set() >= AVX2) return fill_pixels_avx2(dest, pixel, count);
+    return fill_pixels_sse2(dest, pixel, count);
+#else
+    fill_pixels_scalar(dest, pixel, count);
+#endif
+}
+
+void rgba_to_rgb(const uint8_t *source, uint8_t *dest, size_t count){
+#ifdef PIXEL_KERNELS_X86
+    if(get_instruction_set() >= AVX2) return rgba_to_rgb_avx2(source, dest, count);
+    if(get_instruction_set() >= SSSE3) return rgba_to_rgb_ssse3(source, dest, count);
+#endif
+    rgba_to_rgb_scalar(source, dest, count);
+}
+
+void palette_indexes(const uint8_t *source, size_t count, const uint32_t *palette, int palette_size, uint8_t *indexes){
+#ifdef PIXEL_KERNELS_X86
+    if(get_instruction_set() >= AVX2) return palette_indexes_avx2(source, count, palette, palette_size, indexes);
+    return palette_indexes_sse2(source, count, palette, palette_size, indexes);
+#else
+    palette_indexes_scalar(source, count, palette, palette_size, indexes);
+#endif
+}
+
+void pack_samples(const uint8_t *samples, size_t count, int bit_depth, uint8_t *row){
+#ifdef PIXEL_KERNELS_X86
+    if(get_instruction_set() >= AVX2) return pack_samples_avx2(samples, count, bit_depth, row);
+    if(get_instruction_set() >= SSSE3) return pack_samples_ssse3(samples, count, bit_depth, row);
+#endif
+    pack_samples_scalar(samples, count, bit_depth, row);
+}
+}
+
+#endif
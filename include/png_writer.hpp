@@ -0,0 +1,474 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <zlib.h>
+#include "cancellation.hpp"
+#include "pixel_kernels.hpp"
+
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+namespace PngWriter{
+enum ImageFormat{
+    // 8 bit RGBA PNG, the pixel buffer as it is
+    RGBA = 0,
+    // 8 bit RGB PNG
+    RGB = 1,
+    // Indexed PNG at the smallest bit depth that fits the colours, RGB if there are more than 256
+    Palette = 2,
+    // Grayscale PNGs at 8, 2 and 1 bits per pixel
+    Gray8 = 3,
+    Gray2 = 4,
+    Gray1 = 5,
+    // Uncompressed RGBA PAM (netpbm) file, no encoding cost at all
+    Raw = 6
+};
+
+struct ImageOptions{
+    ImageFormat format;
+    // zlib level, 0 stores, 1 is the fast codec (run length only), 9 is smallest, -1 is zlib's default
+    int compression_level;
+
+    ImageOptions(ImageFormat format = RGBA, int compression_level = -1): format(format), compression_level(compression_level){}
+};
+
+/**
+ * @brief Get the file extension images in a format should be saved with
+ *
+ * @param format The image format
+ * @return std::string The extension, including the dot
+ */
+std::string get_file_extension(ImageFormat format){
+    return format == Raw ? ".pam" : ".png";
+}
+
+static const std::pair<const char*, ImageFormat> image_format_names[] = {
+    {"rgba", RGBA}, {"rgb", RGB}, {"palette", Palette},
+    {"gray8", Gray8}, {"gray2", Gray2}, {"gray1", Gray1},
+    {"raw", Raw}
+};
+
+/**
+ * @brief Look up an image format by the name callers pass in
+ *
+ * @param name rgba, rgb, palette, gray8, gray2, gray1 or raw
+ * @param format Set to the format when the name is known
+ * @return true The name is a format
+ */
+bool get_image_format(std::string name, ImageFormat &format){
+    for(const std::pair<const char*, ImageFormat> &format_name: image_format_names){
+        if(name == format_name.first){
+            format = format_name.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void append_uint32(std::vector<uint8_t> &out, uint32_t value){
+    out.push_back((value >> 24) & 0xFF);
+    out.push_back((value >> 16) & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+/**
+ * @brief Append a chunk, its length, type, data and CRC, to a PNG stream
+ *
+ * @param out The PNG stream
+ * @param type Four character chunk type
+ * @param data Chunk data
+ * @param length Length of the chunk data
+ */
+void append_chunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, uint32_t length){
+    append_uint32(out, length);
+
+    size_t type_start = out.size();
+    out.insert(out.end(), type, type + 4);
+    if(length > 0) out.insert(out.end(), data, data + length);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, out.data() + type_start, length + 4);
+    append_uint32(out, crc);
+}
+
+/**
+ * @brief The layout of the scanlines a PNG is written with
+ */
+struct PngLayout{
+    ImageFormat format;
+    int bit_depth;
+    int color_type;
+    int width;
+    std::vector<uint8_t> palette;
+    std::unordered_map<uint32_t, uint8_t> palette_indexes;
+    // The palette as packed pixels without alpha, for matching small palettes with vector compares
+    std::vector<uint32_t> palette_colors;
+    // One sample per pixel of the row being converted, before it is packed into bits
+    std::vector<uint8_t> row_samples;
+
+    PngLayout(ImageFormat format, int width): format(format), bit_depth(8), color_type(6), width(width){
+        if(format == RGB) color_type = 2;
+        if(format == Gray8 || format == Gray2 || format == Gray1) color_type = 0;
+        if(format == Gray2) bit_depth = 2;
+        if(format == Gray1) bit_depth = 1;
+    }
+
+    /**
+     * @brief Build the palette for an image, falling back to RGB when it has more than 256 colours
+     *
+     * @param pixels width * height RGBA pixels
+     * @param pixel_count Number of pixels
+     */
+    void build_palette(const uint8_t *pixels, size_t pixel_count){
+        uint32_t last_color = 0;
+        bool have_last_color = false;
+
+        for(size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++){
+            const uint8_t *pixel = pixels + (pixel_index * 4);
+            uint32_t color = (pixel[0] << 16) | (pixel[1] << 8) | pixel[2];
+
+            // Maze images are long runs of one colour, skip the lookup for those
+            if(have_last_color && color == last_color) continue;
+            last_color = color;
+            have_last_color = true;
+
+            if(palette_indexes.count(color)) continue;
+
+            if(palette_indexes.size() == 256){
+                format = RGB;
+                color_type = 2;
+                bit_depth = 8;
+                palette.clear();
+                palette_indexes.clear();
+                palette_colors.clear();
+                return;
+            }
+
+            uint8_t next_index = palette_indexes.size();
+            palette_indexes[color] = next_index;
+            palette.insert(palette.end(), {pixel[0], pixel[1], pixel[2]});
+            palette_colors.push_back(PixelKernels::pack_pixel(pixel[0], pixel[1], pixel[2], 0));
+        }
+
+        color_type = 3;
+        int color_count = palette_indexes.size();
+        if(color_count <= 2) bit_depth = 1;
+        else if(color_count <= 4) bit_depth = 2;
+        else if(color_count <= 16) bit_depth = 4;
+        else bit_depth = 8;
+    }
+
+    size_t get_row_bytes(){
+        int channels = 1;
+        if(color_type == 6) channels = 4;
+        if(color_type == 2) channels = 3;
+
+        return (((size_t)width * channels * bit_depth) + 7) / 8;
+    }
+
+    /**
+     * @brief Convert one row of RGBA pixels to this layout
+     *
+     * @param source width RGBA pixels
+     * @param row get_row_bytes() bytes to write the scanline into
+     */
+    void convert_row(const uint8_t *source, uint8_t *row){
+        if(color_type == 6){
+            memcpy(row, source, (size_t)width * 4);
+            return;
+        }
+
+        if(color_type == 2){
+            PixelKernels::rgba_to_rgb(source, row, width);
+            return;
+        }
+
+        // Everything else is one sample per pixel, packed most significant bits first
+        row_samples.resize(width);
+        if(color_type == 3 && palette_colors.size() <= PIXEL_KERNELS_MAX_VECTOR_PALETTE){
+            PixelKernels::palette_indexes(source, width, palette_colors.data(), palette_colors.size(), row_samples.data());
+        }else if(color_type == 3){
+            uint32_t last_color = 0xFFFFFFFF;
+            int last_value = 0;
+            for(int x = 0; x < width; x++){
+                const uint8_t *pixel = source + (x * 4);
+                uint32_t color = (pixel[0] << 16) | (pixel[1] << 8) | pixel[2];
+                if(color != last_color){
+                    last_color = color;
+                    last_value = palette_indexes[color];
+                }
+                row_samples[x] = last_value;
+            }
+        }else{
+            int max_value = (1 << bit_depth) - 1;
+            for(int x = 0; x < width; x++){
+                const uint8_t *pixel = source + (x * 4);
+                int luminance = ((pixel[0] * 77) + (pixel[1] * 150) + (pixel[2] * 29)) >> 8;
+                row_samples[x] = ((luminance * max_value) + 127) / 255;
+            }
+        }
+
+        if(bit_depth == 8){
+            memcpy(row, row_samples.data(), width);
+            return;
+        }
+
+        PixelKernels::pack_samples(row_samples.data(), width, bit_depth, row);
+    }
+};
+
+/**
+ * @brief Deflate a buffer into a zlib stream
+ *
+ * @param data Data to compress
+ * @param compression_level zlib compression level, 1 switches to run length encoding
+ * @param out Where to write the stream
+ * @return true Compression succeeded
+ * @return false Compression failed
+ */
+bool deflate_buffer(std::vector<uint8_t> &data, int compression_level, std::vector<uint8_t> &out){
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    int strategy = compression_level == 1 ? Z_RLE : Z_DEFAULT_STRATEGY;
+    if(deflateInit2(&stream, compression_level, Z_DEFLATED, 15, 8, strategy) != Z_OK) return false;
+
+    out.resize(deflateBound(&stream, data.size()));
+    stream.next_in = data.data();
+    stream.avail_in = data.size();
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    return result == Z_STREAM_END;
+}
+
+// Size of the IDAT chunks a stream writes, the compressed image is split across as many as it needs
+#define PNG_STREAM_CHUNK_SIZE 65536
+
+/**
+ * @brief Writes an image one row at a time, so an image never has to be held in memory in full.
+ * Output goes straight to a file, or is collected in memory when no file is given.
+ */
+struct PngStream{
+private:
+    FILE *file;
+    int width, height, rows_written;
+    ImageOptions options;
+    PngLayout layout;
+    z_stream stream;
+    bool stream_open, failed;
+    std::vector<uint8_t> output, scanline, compressed;
+
+    /**
+     * @brief Hand everything written so far to the file, in memory streams keep it
+     */
+    void flush_output(){
+        if(!file || output.empty()) return;
+
+        if(fwrite(output.data(), 1, output.size(), file) != output.size()) failed = true;
+        output.clear();
+    }
+
+    /**
+     * @brief Run deflate over the pending input, writing an IDAT chunk every time the buffer fills
+     */
+    void deflate_pending(int flush){
+        int result = Z_OK;
+
+        do{
+            result = deflate(&stream, flush);
+            if(result == Z_STREAM_ERROR){
+                failed = true;
+                return;
+            }
+
+            size_t compressed_bytes = compressed.size() - stream.avail_out;
+            if(stream.avail_out == 0 || (flush == Z_FINISH && compressed_bytes > 0)){
+                append_chunk(output, "IDAT", compressed.data(), compressed_bytes);
+                flush_output();
+                stream.next_out = compressed.data();
+                stream.avail_out = compressed.size();
+            }
+        }while(stream.avail_in > 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+    }
+public:
+    PngStream(FILE *file, int width, int height, ImageOptions options = ImageOptions()): file(file), width(width), height(height), rows_written(0), options(options), layout(options.format, width), stream_open(false), failed(false){
+        memset(&stream, 0, sizeof(stream));
+    }
+
+    ~PngStream(){
+        if(stream_open) deflateEnd(&stream);
+    }
+
+    PngStream(const PngStream&) = delete;
+    PngStream& operator=(const PngStream&) = delete;
+
+    /**
+     * @brief Write the image header
+     *
+     * @param palette_pixels RGBA pixels holding every colour the image uses, the palette format
+     * needs these up front and falls back to RGB without them
+     * @param palette_pixel_count Number of palette pixels
+     * @return true The header was written
+     * @return false The encoder couldn't be set up or writing failed
+     */
+    bool begin(const uint8_t *palette_pixels = NULL, size_t palette_pixel_count = 0){
+        if(options.format == Raw){
+            std::string header = "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height) + "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+            output.insert(output.end(), header.begin(), header.end());
+            flush_output();
+            return !failed;
+        }
+
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        output.insert(output.end(), signature, signature + 8);
+
+        if(options.format == Palette){
+            if(palette_pixels){
+                layout.build_palette(palette_pixels, palette_pixel_count);
+            }else{
+                layout = PngLayout(RGB, width);
+            }
+        }
+
+        // Default compression, filter and interlace methods
+        std::vector<uint8_t> header;
+        append_uint32(header, width);
+        append_uint32(header, height);
+        header.insert(header.end(), {(uint8_t)layout.bit_depth, (uint8_t)layout.color_type, 0, 0, 0});
+        append_chunk(output, "IHDR", header.data(), header.size());
+
+        if(layout.color_type == 3){
+            append_chunk(output, "PLTE", layout.palette.data(), layout.palette.size());
+        }
+
+        int strategy = options.compression_level == 1 ? Z_RLE : Z_DEFAULT_STRATEGY;
+        if(deflateInit2(&stream, options.compression_level, Z_DEFLATED, 15, 8, strategy) != Z_OK) return false;
+        stream_open = true;
+
+        // Every scanline is prefixed with its filter type, 0 leaves it unfiltered
+        scanline.assign(layout.get_row_bytes() + 1, 0);
+        compressed.resize(PNG_STREAM_CHUNK_SIZE);
+        stream.next_out = compressed.data();
+        stream.avail_out = compressed.size();
+
+        flush_output();
+        return !failed;
+    }
+
+    /**
+     * @brief Write the next row of the image
+     *
+     * @param row width RGBA pixels
+     * @return true The row was written
+     * @return false Encoding or writing failed, or every row has already been written
+     */
+    bool write_row(const uint8_t *row){
+        if(failed || rows_written >= height) return false;
+        rows_written++;
+
+        if(options.format == Raw){
+            output.insert(output.end(), row, row + ((size_t)width * 4));
+            flush_output();
+            return !failed;
+        }
+
+        if(!stream_open) return false;
+
+        layout.convert_row(row, &scanline[1]);
+        stream.next_in = scanline.data();
+        stream.avail_in = scanline.size();
+        deflate_pending(Z_NO_FLUSH);
+
+        return !failed;
+    }
+
+    /**
+     * @brief Finish the image once every row is written
+     *
+     * @return true The image is complete
+     * @return false Rows are missing, or encoding or writing failed
+     */
+    bool finish(){
+        if(failed || rows_written != height) return false;
+
+        if(options.format != Raw){
+            if(!stream_open) return false;
+
+            deflate_pending(Z_FINISH);
+            deflateEnd(&stream);
+            stream_open = false;
+
+            append_chunk(output, "IEND", NULL, 0);
+        }
+
+        flush_output();
+        return !failed;
+    }
+
+    /**
+     * @brief Get the image written by a stream without a file
+     */
+    std::vector<uint8_t>& get_output(){
+        return output;
+    }
+};
+
+/**
+ * @brief Encode an 8 bit RGBA buffer as a PNG, or a PAM for the raw format
+ *
+ * @param pixels width * height RGBA pixels
+ * @param width Image width
+ * @param height Image height
+ * @param options Output format and compression level
+ * @return std::vector<uint8_t> The encoded image, empty if compression failed
+ */
+std::vector<uint8_t> encode_png(const uint8_t *pixels, int width, int height, ImageOptions options = ImageOptions()){
+    PngStream png(NULL, width, height, options);
+
+    if(!png.begin(pixels, (size_t)width * height)) return std::vector<uint8_t>();
+
+    for(int y = 0; y < height; y++){
+        if(Cancellation::is_cancelled()) return std::vector<uint8_t>();
+        png.write_row(pixels + ((size_t)y * width * 4));
+    }
+
+    if(!png.finish()) return std::vector<uint8_t>();
+
+    return std::move(png.get_output());
+}
+
+/**
+ * @brief Encode an 8 bit RGBA buffer and write it to a file
+ *
+ * @param filename File to write
+ * @param pixels width * height RGBA pixels
+ * @param width Image width
+ * @param height Image height
+ * @param options Output format and compression level
+ * @return true The file was written
+ * @return false Encoding or writing failed
+ */
+bool save_png(std::string filename, const uint8_t *pixels, int width, int height, ImageOptions options = ImageOptions()){
+    std::vector<uint8_t> png = encode_png(pixels, width, height, options);
+    if(png.empty()) return false;
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if(!file) return false;
+
+    bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+    fclose(file);
+
+    return written;
+}
+}
+#endif
@@ -0,0 +1,168 @@
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include "map.hpp"
+#include "thread_pool.hpp"
+
+#ifndef SKELETON_POOL_H
+#define SKELETON_POOL_H
+
+// Grid sizes kept at once, the one asked for least recently is dropped to make room for another
+#define SKELETON_POOL_MAX_SIZES 16
+
+/**
+ * @brief Solved mazes generated ahead of time on background threads, so a word maze only has to
+ * fit its word in, letter and draw. Every grid size and algorithm keeps its own skeletons, ordered
+ * by how many junctions their solution path has, and each one taken is replaced in the background.
+ * The pool holds nothing until configure turns it on.
+ */
+struct SkeletonPool{
+    // Grid width, grid height and generator type
+    typedef std::tuple<int, int, int> SizeKey;
+
+    struct Bucket{
+        // Skeletons by the junction count of their solution path
+        std::multimap<size_t, std::unique_ptr<Maze>> skeletons;
+        int pending_refills;
+        // Refills queued for a bucket that has since been dropped check this and give up
+        uint64_t bucket_id, last_used;
+
+        Bucket(): pending_refills(0), bucket_id(0), last_used(0){}
+    };
+
+    std::mutex mutex;
+    std::map<SizeKey, Bucket> buckets;
+    int skeletons_per_size;
+    uint64_t next_bucket_id, use_count;
+    std::unique_ptr<ThreadPool> refill_pool;
+
+    SkeletonPool(): skeletons_per_size(0), next_bucket_id(1), use_count(0){}
+
+    ~SkeletonPool(){
+        configure(0);
+    }
+
+    /**
+     * @brief Turn the pool on, resize it or turn it off, dropping every skeleton it has
+     *
+     * @param new_skeletons_per_size Skeletons to keep ready for each grid size and algorithm, 0 turns the pool off
+     * @param thread_count Background threads generating skeletons, anything below 1 uses one per core
+     */
+    void configure(int new_skeletons_per_size, int thread_count = 1){
+        std::unique_ptr<ThreadPool> old_refill_pool;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            old_refill_pool = std::move(refill_pool);
+            buckets.clear();
+            skeletons_per_size = std::max(new_skeletons_per_size, 0);
+            if(skeletons_per_size > 0) refill_pool.reset(new ThreadPool(thread_count));
+        }
+        // Queued refills find their bucket gone and return at once, so this only waits on skeletons already being generated
+        old_refill_pool.reset();
+    }
+
+    /**
+     * @brief Take a skeleton to put a word on, another is generated in the background to replace it
+     *
+     * @param junction_count Junctions the word needs on the solution path
+     * @return std::unique_ptr<Maze> The skeleton, NULL if the pool is off or has none of this size ready
+     */
+    std::unique_ptr<Maze> take(int grid_width, int grid_height, GeneratorType generator_type, size_t junction_count){
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<Maze> skeleton;
+
+        if(skeletons_per_size == 0) return skeleton;
+
+        SizeKey key(grid_width, grid_height, generator_type);
+        Bucket &bucket = get_bucket(key);
+        if(!bucket.skeletons.empty()){
+            // The fewest junctions that hold the word, failing that the most, which needs the least reshaping
+            std::multimap<size_t, std::unique_ptr<Maze>>::iterator found = bucket.skeletons.lower_bound(junction_count);
+            if(found == bucket.skeletons.end()) found = std::prev(found);
+
+            skeleton = std::move(found->second);
+            bucket.skeletons.erase(found);
+            MAZE_COUNT(PooledSkeletons, 1);
+        }
+
+        queue_refills(key, bucket);
+        return skeleton;
+    }
+
+    /**
+     * @brief Count the skeletons ready for a grid size and algorithm
+     */
+    int get_ready_count(int grid_width, int grid_height, GeneratorType generator_type){
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<SizeKey, Bucket>::iterator found = buckets.find(SizeKey(grid_width, grid_height, generator_type));
+
+        if(found == buckets.end()) return 0;
+        return found->second.skeletons.size();
+    }
+
+private:
+    Bucket& get_bucket(SizeKey key){
+        std::map<SizeKey, Bucket>::iterator found = buckets.find(key);
+
+        if(found == buckets.end()){
+            if(buckets.size() >= SKELETON_POOL_MAX_SIZES){
+                std::map<SizeKey, Bucket>::iterator oldest = buckets.begin();
+                for(std::map<SizeKey, Bucket>::iterator bucket = buckets.begin(); bucket != buckets.end(); bucket++){
+                    if(bucket->second.last_used < oldest->second.last_used) oldest = bucket;
+                }
+                buckets.erase(oldest);
+            }
+
+            found = buckets.emplace(key, Bucket()).first;
+            found->second.bucket_id = next_bucket_id++;
+        }
+
+        found->second.last_used = ++use_count;
+        return found->second;
+    }
+
+    Bucket* find_bucket(SizeKey key, uint64_t bucket_id){
+        std::map<SizeKey, Bucket>::iterator found = buckets.find(key);
+
+        if(found == buckets.end() || found->second.bucket_id != bucket_id) return NULL;
+        return &found->second;
+    }
+
+    void queue_refills(SizeKey key, Bucket &bucket){
+        uint64_t bucket_id = bucket.bucket_id;
+
+        while((int)bucket.skeletons.size() + bucket.pending_refills < skeletons_per_size){
+            bucket.pending_refills++;
+            refill_pool->submit([this, key, bucket_id]{ refill(key, bucket_id); });
+        }
+    }
+
+    void refill(SizeKey key, uint64_t bucket_id){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!find_bucket(key, bucket_id)) return;
+        }
+
+        // Generated exactly as a WordMaze generates before its word goes on, so pooled mazes are
+        // still the maze their seed gives
+        std::unique_ptr<Maze> skeleton(new Maze(std::get<0>(key), std::get<1>(key), 1, 1, RandomContext::random_seed(), false, GeneratorType(std::get<2>(key))));
+        size_t junction_count = skeleton->solution_path ? skeleton->get_solution_path_junctions().size() : 0;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Bucket *bucket = find_bucket(key, bucket_id);
+        if(!bucket) return;
+
+        bucket->pending_refills--;
+        if(skeleton->solution_path) bucket->skeletons.emplace(junction_count, std::move(skeleton));
+    }
+};
+
+SkeletonPool& get_skeleton_pool(){
+    static SkeletonPool skeleton_pool;
+    return skeleton_pool;
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include <climits>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "utils.hpp"
+#include "drawable.hpp"
+#include "font_cache.hpp"
+#include "generators.hpp"
+#include "png_writer.hpp"
+
+#ifndef STREAMING_MAZE_H
+#define STREAMING_MAZE_H
+
+using namespace Drawable;
+
+/**
+ * @brief A plain maze too big to keep in memory, generated with Eller's algorithm one block row at
+ * a time and drawn straight into a streamed image. Only one row of cells and one row of blocks
+ * worth of pixels are ever held, so memory grows with the width and not the area.
+ */
+struct StreamingMaze{
+    RandomContext random;
+    int grid_width, grid_height, block_width, block_height;
+    Color wall_color, background_color;
+
+    StreamingMaze(int grid_width, int grid_height, int block_width = 4, int block_height = 4, uint64_t seed = RandomContext::random_seed()): random(seed), grid_width(grid_width), grid_height(grid_height), block_width(block_width), block_height(block_height), wall_color(COLOR_BLACK), background_color(COLOR_WHITE){}
+
+    /**
+     * @brief Whether a maze this size can be drawn, the whole image has to fit a PNG's int sized
+     * sides and one row of blocks has to fit a Drawable2D, there's no limit on the area
+     */
+    static bool is_valid_size(int grid_width, int grid_height, int block_width, int block_height){
+        if(grid_width < 1 || grid_height < 1 || block_width < 1 || block_height < 1) return false;
+        if((int64_t)grid_height * block_height > INT_MAX) return false;
+        return Drawable2D::is_valid_size((int64_t)grid_width * block_width, block_height);
+    }
+
+    /**
+     * @throws std::length_error The maze is too large to draw, see is_valid_size
+     */
+    void check_size(){
+        if(is_valid_size(grid_width, grid_height, block_width, block_height)) return;
+        throw std::length_error("A " + std::to_string(grid_width) + "x" + std::to_string(grid_height) + " maze with " + std::to_string(block_width) + "x" + std::to_string(block_height) + " blocks can't be drawn");
+    }
+
+    /**
+     * @brief Generate and draw the maze into a stream, the same seed always draws the same maze
+     *
+     * @param png The stream, begin has not been called on it yet
+     * @return true Every row was written
+     * @return false Encoding or writing failed
+     */
+    bool render(PngWriter::PngStream &png){
+        RandomContext row_random(random.seed);
+        EllerRowGenerator rows(grid_width);
+        std::shared_ptr<const BlockTiles> block_tiles = get_font_cache().get_block_tiles(block_width, block_height, wall_color, background_color, false);
+        Drawable2D row_canvas((int64_t)grid_width * block_width, block_height);
+        int start_x = row_random.get_rand_int(0, grid_width - 1);
+        int end_x = row_random.get_rand_int(0, grid_width - 1);
+
+        // Both colours side by side, so a palette can be built before any row is drawn
+        uint8_t palette_pixels[8];
+        Drawable2D::write_pixel(palette_pixels, wall_color);
+        Drawable2D::write_pixel(palette_pixels + 4, background_color);
+        if(!png.begin(palette_pixels, 2)) return false;
+
+        for(int y = 0; y < grid_height; y++){
+            if(Cancellation::is_cancelled()) return false;
+            rows.next_row(row_random, y == grid_height - 1);
+
+            for(int x = 0; x < grid_width; x++){
+                uint8_t open_mask = rows.open_masks[x];
+                if(y == 0 && x == start_x) open_mask |= direction_bit(North);
+                if(y == grid_height - 1 && x == end_x) open_mask |= direction_bit(South);
+
+                const uint8_t *tile = block_tiles->get_tile(~open_mask & ALL_DIRECTIONS_MASK, true);
+                row_canvas.draw_portion(x * block_width, 0, block_width, block_height, tile);
+            }
+
+            for(int pixel_y = 0; pixel_y < block_height; pixel_y++){
+                if(!png.write_row(row_canvas.get_pixel(0, pixel_y))) return false;
+            }
+        }
+
+        return png.finish();
+    }
+
+    /**
+     * @brief Draw the maze into a file, which is removed again if it couldn't be written in full
+     *
+     * @throws std::length_error The maze is too large to draw, checked before the file is opened
+     */
+    bool save_to_png(std::string filename, PngWriter::ImageOptions options = PngWriter::ImageOptions()){
+        check_size();
+        FILE *file = fopen(filename.c_str(), "wb");
+        if(!file) return false;
+
+        bool written = false;
+        try{
+            PngWriter::PngStream png(file, grid_width * block_width, grid_height * block_height, options);
+            written = render(png);
+        }catch(...){
+            fclose(file);
+            remove(filename.c_str());
+            throw;
+        }
+
+        if(fclose(file) != 0) written = false;
+        if(!written) remove(filename.c_str());
+
+        return written;
+    }
+
+    /**
+     * @throws std::length_error The maze is too large to draw
+     */
+    std::vector<uint8_t> encode_to_png(PngWriter::ImageOptions options = PngWriter::ImageOptions()){
+        check_size();
+        PngWriter::PngStream png(NULL, grid_width * block_width, grid_height * block_height, options);
+
+        if(!render(png)) return std::vector<uint8_t>();
+
+        return std::move(png.get_output());
+    }
+};
+
+#endif
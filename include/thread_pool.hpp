@@ -0,0 +1,135 @@
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/**
+ * @brief A fixed set of worker threads pulling jobs off a shared queue
+ */
+struct ThreadPool{
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex jobs_mutex;
+    std::condition_variable job_available, jobs_finished;
+    int jobs_running;
+    bool stopping;
+
+    void worker_loop(){
+        while(true){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(jobs_mutex);
+                job_available.wait(lock, [this]{ return stopping || !jobs.empty(); });
+
+                if(jobs.empty()) return;
+
+                job = std::move(jobs.front());
+                jobs.pop();
+                jobs_running++;
+            }
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(jobs_mutex);
+                jobs_running--;
+                if(jobs.empty() && jobs_running == 0) jobs_finished.notify_all();
+            }
+        }
+    }
+public:
+    /**
+     * @brief Start the worker threads
+     *
+     * @param thread_count Number of workers, anything below 1 uses one per core
+     */
+    ThreadPool(int thread_count = 0): jobs_running(0), stopping(false){
+        if(thread_count < 1) thread_count = default_thread_count();
+
+        for(int thread_index = 0; thread_index < thread_count; thread_index++){
+            workers.emplace_back(&ThreadPool::worker_loop, this);
+        }
+    }
+
+    ~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            stopping = true;
+        }
+        job_available.notify_all();
+
+        for(std::thread &worker: workers){
+            worker.join();
+        }
+    }
+
+    /**
+     * @brief Get the number of threads to use when none was requested
+     *
+     * @return int The hardware thread count, or 1 if it is unknown
+     */
+    static int default_thread_count(){
+        int thread_count = std::thread::hardware_concurrency();
+        return thread_count > 0 ? thread_count : 1;
+    }
+
+    int get_thread_count(){
+        return workers.size();
+    }
+
+    /**
+     * @brief Queue a job to be run on the next free worker
+     *
+     * @param job The job to run, it has to catch its own exceptions since nothing on the worker can
+     */
+    void submit(std::function<void()> job){
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            jobs.push(std::move(job));
+        }
+        job_available.notify_one();
+    }
+
+    /**
+     * @brief Block until every queued job has finished
+     */
+    void wait(){
+        std::unique_lock<std::mutex> lock(jobs_mutex);
+        jobs_finished.wait(lock, [this]{ return jobs.empty() && jobs_running == 0; });
+    }
+
+    /**
+     * @brief Run a job once for every index in [0, count) and wait for all of them. An exception
+     * from any index is rethrown here once every index has run, the first one thrown if there are several.
+     *
+     * @param count Number of indexes to run
+     * @param job The job, called with the index it should work on
+     */
+    void parallel_for(int count, std::function<void(int)> job){
+        std::exception_ptr first_exception;
+        std::mutex exception_mutex;
+
+        for(int index = 0; index < count; index++){
+            submit([&job, &first_exception, &exception_mutex, index]{
+                try{
+                    job(index);
+                }catch(...){
+                    std::lock_guard<std::mutex> lock(exception_mutex);
+                    if(!first_exception) first_exception = std::current_exception();
+                }
+            });
+        }
+        wait();
+
+        if(first_exception) std::rethrow_exception(first_exception);
+    }
+};
+
+#endif
@@ -1,7 +1,11 @@
 #include <cmath>
+#include <cstdint>
+#include <ctime>
 #include <vector>
 #include <memory>
 #include <random>
+#include <set>
+#include <string>
 
 #ifndef UTILS_H
 #define UTILS_H
@@ -14,6 +18,30 @@ enum GridDirection{
     None = 4
 };
 
+#define ALL_DIRECTIONS_MASK 0x0F
+
+/**
+ * @brief Get the bit a direction occupies in a direction mask
+ *
+ * @param direction The direction
+ * @return uint8_t The bit for the direction, 0 for None
+ */
+uint8_t direction_bit(GridDirection direction){
+    if(direction == None) return 0;
+    return 1 << direction;
+}
+
+/**
+ * @brief Count how many directions are set in a direction mask
+ *
+ * @param mask The direction mask
+ * @return int Number of directions in the mask
+ */
+int direction_mask_count(uint8_t mask){
+    static const uint8_t mask_counts[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+    return mask_counts[mask & ALL_DIRECTIONS_MASK];
+}
+
 template <typename T>
 void remove_item_from_vector(std::vector<T*> &list, T *item, bool use_delete = true){
     typename std::vector<T*>::iterator curr_element = list.begin();
@@ -41,12 +69,24 @@ GridDirection get_opposite_direction(GridDirection direction){
     if(direction == South) return North;
     if(direction == East) return West;
     if(direction == West) return East;
+    return None;
 }
 
 /**
- * @brief Used for randomness
+ * @brief Claim a name no one else has, numbering repeats as name_2, name_3 and on, so a batch
+ * listing a word twice never has two threads writing the same file
+ *
+ * @param used_names Names already claimed, the returned name is added to them
+ * @return std::string The name, or the first numbered one still free
  */
-std::default_random_engine generator;
+std::string claim_unused_name(const std::string &name, std::set<std::string> &used_names){
+    std::string claimed = name;
+
+    for(int copy = 2; used_names.count(claimed); copy++) claimed = name + "_" + std::to_string(copy);
+    used_names.insert(claimed);
+
+    return claimed;
+}
 
 /**
  * @brief Used to encapsulate a position in the world
@@ -71,55 +111,113 @@ float get_distance(Position pos1, Position pos2)
 }
 
 /**
- * @brief Get a random uniform float
- *
- * @param from From float
- * @param to To float
- * @return float Random float between from and to float
+ * @brief Small state PCG32 engine, usable anywhere the standard library expects a random engine
  */
-float get_rand_uniform_float(float from, float to)
-{
-    std::uniform_real_distribution<float> distribution(from, to);
-    return distribution(generator);
-}
+struct PCG32Engine{
+private:
+    uint64_t state;
+    uint64_t increment;
+public:
+    typedef uint32_t result_type;
 
-/**
- * @brief Get the random normal float
- *
- * @param mean Mean of the random float distribution
- * @param std_dev Standard deviation for the float distribution
- * @return float Random float given the inputs
- */
-float get_rand_normal_float(float mean, float std_dev)
-{
-    std::normal_distribution<float> distribution(mean, std_dev);
-    return distribution(generator);
-}
+    PCG32Engine(uint64_t seed = 0){
+        this->seed(seed);
+    }
 
-/**
- * @brief Get a random integer
- *
- * @param from From Integer
- * @param to To Integer
- * @return int Random Integer between from and to
- */
-int get_rand_int(int from, int to)
-{
-    std::uniform_real_distribution<float> distribution(from, to);
-    return (int)distribution(generator);
-}
+    void seed(uint64_t seed){
+        state = 0;
+        increment = (seed << 1) | 1;
+        (*this)();
+        state += seed;
+        (*this)();
+    }
+
+    static constexpr result_type min(){ return 0; }
+    static constexpr result_type max(){ return UINT32_MAX; }
+
+    result_type operator()(){
+        uint64_t old_state = state;
+        state = old_state * 6364136223846793005ULL + increment;
+
+        uint32_t xor_shifted = (uint32_t)(((old_state >> 18) ^ old_state) >> 27);
+        uint32_t rotation = (uint32_t)(old_state >> 59);
+
+        return (xor_shifted >> rotation) | (xor_shifted << ((-rotation) & 31));
+    }
+};
 
 /**
- * @brief Get a random boolean
- *
- * @param chance The float chance for true (must be between 0-1)
- * @return true
- * @return false
+ * @brief Used for randomness, every maze owns one so mazes are reproducible from their seed
+ * and can be generated in parallel without sharing any state
  */
-bool get_rand_bool(float chance = 0.5)
-{
-    return get_rand_uniform_float(0.0, 1.0) < chance;
-}
+struct RandomContext{
+    uint64_t seed;
+    PCG32Engine engine;
+
+    RandomContext(uint64_t seed): seed(seed), engine(seed){}
+    RandomContext(): RandomContext(random_seed()){}
+
+    /**
+     * @brief Get a seed that differs between calls, even within the same second
+     *
+     * @return uint64_t A fresh seed
+     */
+    static uint64_t random_seed(){
+        std::random_device device;
+        return ((uint64_t)device() << 32) ^ device() ^ (uint64_t)time(0);
+    }
+
+    /**
+     * @brief Get a random uniform float
+     *
+     * @param from From float
+     * @param to To float
+     * @return float Random float between from and to float
+     */
+    float get_rand_uniform_float(float from, float to){
+        // Top 24 bits fill the float mantissa exactly, giving [0, 1)
+        float unit = (engine() >> 8) * (1.0f / 16777216.0f);
+        return from + (unit * (to - from));
+    }
+
+    /**
+     * @brief Get the random normal float
+     *
+     * @param mean Mean of the random float distribution
+     * @param std_dev Standard deviation for the float distribution
+     * @return float Random float given the inputs
+     */
+    float get_rand_normal_float(float mean, float std_dev){
+        std::normal_distribution<float> distribution(mean, std_dev);
+        return distribution(engine);
+    }
+
+    /**
+     * @brief Get a random integer
+     *
+     * @param from From Integer
+     * @param to To Integer
+     * @return int Random Integer between from and to, both included
+     */
+    int get_rand_int(int from, int to){
+        if(to <= from) return from;
+
+        // Lemire's multiply and shift, the bias is far below anything a maze can show
+        uint64_t range = (uint64_t)((int64_t)to - from) + 1;
+        return from + (int)((engine() * range) >> 32);
+    }
+
+    /**
+     * @brief Get a random boolean
+     *
+     * @param chance The float chance for true (must be between 0-1)
+     * @return true
+     * @return false
+     */
+    bool get_rand_bool(float chance = 0.5){
+        return get_rand_uniform_float(0.0, 1.0) < chance;
+    }
+};
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "map.hpp"
+#include "png_writer.hpp"
+
+#ifndef VECTOR_EXPORT_H
+#define VECTOR_EXPORT_H
+
+namespace VectorExport{
+// Wall thickness in blocks, the raster walls are one pixel on each side of a shared edge
+#define VECTOR_WALL_WIDTH 0.1f
+
+/**
+ * @brief A wall or filled run along one grid line, in block units
+ */
+struct Segment{
+    float x1, y1, x2, y2;
+    Segment(float x1, float y1, float x2, float y2): x1(x1), y1(y1), x2(x2), y2(y2){}
+};
+
+/**
+ * @brief Everything a maze is drawn with, collected in one pass over the cells
+ */
+struct MazeOutline{
+    int grid_width, grid_height;
+    std::vector<Segment> walls;
+    // Runs of unexplored blocks, x1/y1 is the top left and x2/y2 the bottom right
+    std::vector<Segment> filled_runs;
+    std::vector<std::pair<int, char>> letters;
+
+    MazeOutline(Map *map): grid_width(map->grid_width), grid_height(map->grid_height){
+        // Horizontal grid lines, merging neighbouring wall edges into a single segment
+        for(int line_y = 0; line_y <= grid_height; line_y++){
+            int run_start = -1;
+            for(int x = 0; x <= grid_width; x++){
+                bool has_wall = x < grid_width && (
+                    (line_y > 0 && map->get_block(x, line_y - 1)->get_wall_mask() & direction_bit(South)) ||
+                    (line_y < grid_height && map->get_block(x, line_y)->get_wall_mask() & direction_bit(North)));
+
+                if(has_wall && run_start == -1) run_start = x;
+                if(!has_wall && run_start != -1){
+                    walls.push_back(Segment(run_start, line_y, x, line_y));
+                    run_start = -1;
+                }
+            }
+        }
+
+        // Vertical grid lines
+        for(int line_x = 0; line_x <= grid_width; line_x++){
+            int run_start = -1;
+            for(int y = 0; y <= grid_height; y++){
+                bool has_wall = y < grid_height && (
+                    (line_x > 0 && map->get_block(line_x - 1, y)->get_wall_mask() & direction_bit(East)) ||
+                    (line_x < grid_width && map->get_block(line_x, y)->get_wall_mask() & direction_bit(West)));
+
+                if(has_wall && run_start == -1) run_start = y;
+                if(!has_wall && run_start != -1){
+                    walls.push_back(Segment(line_x, run_start, line_x, y));
+                    run_start = -1;
+                }
+            }
+        }
+
+        // Unexplored blocks and letters
+        for(int y = 0; y < grid_height; y++){
+            int run_start = -1;
+            for(int x = 0; x <= grid_width; x++){
+                bool unexplored = x < grid_width && !map->get_block(x, y)->explored;
+
+                if(unexplored && run_start == -1) run_start = x;
+                if(!unexplored && run_start != -1){
+                    filled_runs.push_back(Segment(run_start, y, x, y + 1));
+                    run_start = -1;
+                }
+
+                if(x < grid_width && map->get_block(x, y)->get_letter() != 0){
+                    letters.push_back(std::pair<int, char>((y * grid_width) + x, map->get_block(x, y)->get_letter()));
+                }
+            }
+        }
+    }
+};
+
+std::string format_number(float value){
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%g", value);
+    return buffer;
+}
+
+std::string format_color(Drawable::Color color){
+    char buffer[8];
+    snprintf(buffer, sizeof(buffer), "#%02x%02x%02x", color.r & 0xFF, color.g & 0xFF, color.b & 0xFF);
+    return buffer;
+}
+
+/**
+ * @brief Export a map as an SVG, the view box is in blocks so the document does not grow with block size
+ *
+ * @param map The map to export
+ * @return std::string The SVG document
+ */
+std::string encode_svg(Map *map){
+    MazeOutline outline(map);
+    std::string svg;
+
+    svg += "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" + std::to_string(map->grid_width * map->block_width) +
+           "\" height=\"" + std::to_string(map->grid_height * map->block_height) +
+           "\" viewBox=\"0 0 " + std::to_string(outline.grid_width) + " " + std::to_string(outline.grid_height) + "\">\n";
+    svg += "<rect width=\"100%\" height=\"100%\" fill=\"" + format_color(map->get_background_color()) + "\"/>\n";
+
+    if(!outline.filled_runs.empty()){
+        svg += "<path fill=\"#000000\" d=\"";
+        for(Segment &run: outline.filled_runs){
+            svg += "M" + format_number(run.x1) + " " + format_number(run.y1) + "H" + format_number(run.x2) +
+                   "V" + format_number(run.y2) + "H" + format_number(run.x1) + "Z";
+        }
+        svg += "\"/>\n";
+    }
+
+    svg += "<path fill=\"none\" stroke=\"" + format_color(map->get_wall_color()) + "\" stroke-width=\"" + format_number(VECTOR_WALL_WIDTH) + "\" stroke-linecap=\"square\" d=\"";
+    for(Segment &wall: outline.walls){
+        svg += "M" + format_number(wall.x1) + " " + format_number(wall.y1) + "L" + format_number(wall.x2) + " " + format_number(wall.y2);
+    }
+    svg += "\"/>\n";
+
+    // Letters sit where the raster path puts them, a quarter block in with the baseline three quarters down
+    svg += "<g font-family=\"sans-serif\" font-size=\"1\" fill=\"#000000\">\n";
+    for(std::pair<int, char> &letter: outline.letters){
+        std::string text(1, letter.second);
+        if(letter.second == '<') text = "&lt;";
+        if(letter.second == '>') text = "&gt;";
+        if(letter.second == '&') text = "&amp;";
+
+        svg += "<text x=\"" + format_number((letter.first % outline.grid_width) + 0.25f) +
+               "\" y=\"" + format_number((letter.first / outline.grid_width) + 0.75f) + "\">" + text + "</text>\n";
+    }
+    svg += "</g>\n</svg>\n";
+
+    return svg;
+}
+
+/**
+ * @brief Export a map as a single page PDF, letters use the built in Helvetica font
+ *
+ * @param map The map to export
+ * @param block_size Size of a block on the page in points
+ * @return std::vector<uint8_t> The PDF file
+ */
+std::vector<uint8_t> encode_pdf(Map *map, float block_size = 20){
+    MazeOutline outline(map);
+    float page_width = outline.grid_width * block_size, page_height = outline.grid_height * block_size;
+    std::string content;
+
+    // Flip to a top left origin measured in blocks so the outline can be written as is
+    content += format_number(block_size) + " 0 0 " + format_number(-block_size) + " 0 " + format_number(page_height) + " cm\n";
+
+    Drawable::Color background = map->get_background_color(), wall = map->get_wall_color();
+    content += format_number(background.r / 255.0f) + " " + format_number(background.g / 255.0f) + " " + format_number(background.b / 255.0f) + " rg\n";
+    content += "0 0 " + std::to_string(outline.grid_width) + " " + std::to_string(outline.grid_height) + " re f\n";
+
+    content += "0 g\n";
+    for(Segment &run: outline.filled_runs){
+        content += format_number(run.x1) + " " + format_number(run.y1) + " " + format_number(run.x2 - run.x1) + " " + format_number(run.y2 - run.y1) + " re\n";
+    }
+    if(!outline.filled_runs.empty()) content += "f\n";
+
+    content += format_number(wall.r / 255.0f) + " " + format_number(wall.g / 255.0f) + " " + format_number(wall.b / 255.0f) + " RG\n";
+    content += format_number(VECTOR_WALL_WIDTH) + " w 2 J\n";
+    for(Segment &wall_segment: outline.walls){
+        content += format_number(wall_segment.x1) + " " + format_number(wall_segment.y1) + " m " + format_number(wall_segment.x2) + " " + format_number(wall_segment.y2) + " l\n";
+    }
+    content += "S\n";
+
+    // The text matrix flips glyphs back upright inside the flipped page
+    content += "0 g BT /F1 1 Tf\n";
+    for(std::pair<int, char> &letter: outline.letters){
+        std::string text(1, letter.second);
+        if(letter.second == '(' || letter.second == ')' || letter.second == '\\') text = "\\" + text;
+
+        content += "1 0 0 -1 " + format_number((letter.first % outline.grid_width) + 0.25f) + " " +
+                   format_number((letter.first / outline.grid_width) + 0.75f) + " Tm (" + text + ") Tj\n";
+    }
+    content += "ET\n";
+
+    std::vector<uint8_t> content_bytes(content.begin(), content.end()), compressed;
+    bool deflated = PngWriter::deflate_buffer(content_bytes, Z_DEFAULT_COMPRESSION, compressed);
+    if(!deflated) compressed = content_bytes;
+
+    std::vector<std::string> objects;
+    objects.push_back("<< /Type /Catalog /Pages 2 0 R >>");
+    objects.push_back("<< /Type /Pages /Kids [3 0 R] /Count 1 >>");
+    objects.push_back("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 " + format_number(page_width) + " " + format_number(page_height) +
+                      "] /Contents 4 0 R /Resources << /Font << /F1 5 0 R >> >> >>");
+    // The content stream, written out with its data below
+    objects.push_back("");
+    objects.push_back("<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>");
+
+    std::string pdf = "%PDF-1.4\n";
+    std::vector<size_t> offsets;
+    for(size_t object_index = 0; object_index < objects.size(); object_index++){
+        offsets.push_back(pdf.size());
+        pdf += std::to_string(object_index + 1) + " 0 obj\n";
+
+        if(object_index == 3){
+            pdf += "<< /Length " + std::to_string(compressed.size()) + (deflated ? " /Filter /FlateDecode" : "") + " >>\nstream\n";
+            pdf.append(compressed.begin(), compressed.end());
+            pdf += "\nendstream";
+        }else{
+            pdf += objects[object_index];
+        }
+
+        pdf += "\nendobj\n";
+    }
+
+    size_t xref_offset = pdf.size();
+    pdf += "xref\n0 " + std::to_string(objects.size() + 1) + "\n0000000000 65535 f \n";
+    for(size_t offset: offsets){
+        char entry[21];
+        snprintf(entry, sizeof(entry), "%010zu 00000 n \n", offset);
+        pdf += entry;
+    }
+    pdf += "trailer\n<< /Size " + std::to_string(objects.size() + 1) + " /Root 1 0 R >>\nstartxref\n" + std::to_string(xref_offset) + "\n%%EOF\n";
+
+    return std::vector<uint8_t>(pdf.begin(), pdf.end());
+}
+
+bool save_file(std::string filename, const std::string &data){
+    FILE *file = fopen(filename.c_str(), "wb");
+    if(!file) return false;
+
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+
+    return written;
+}
+
+bool save_svg(std::string filename, Map *map){
+    return save_file(filename, encode_svg(map));
+}
+
+bool save_pdf(std::string filename, Map *map, float block_size = 20){
+    std::vector<uint8_t> pdf = encode_pdf(map, block_size);
+    return save_file(filename, std::string(pdf.begin(), pdf.end()));
+}
+}
+#endif
@@ -1,15 +1,715 @@
+#include "../include/cancellation.hpp"
 #include "../include/map.hpp"
+#include "../include/maze_archive.hpp"
+#include "../include/skeleton_pool.hpp"
+#include "../include/streaming_maze.hpp"
+#include "../include/thread_pool.hpp"
+#include "../include/vector_export.hpp"
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <climits>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <unordered_set>
 
+namespace py = pybind11;
 
-void generate_maze(std::string word, int grid_width, int grid_height, std::string file_prefix, int block_width = 20, int block_height = 20){
-    generator.seed(time(0));
-    WordMaze m(word, grid_width, grid_height, block_width, block_height);
-    m.save_to_png(file_prefix + word + ".png");
+/**
+ * @brief Turn the seed passed in from Python into a maze seed, negative seeds ask for a fresh one
+ */
+uint64_t resolve_seed(int64_t seed){
+    if(seed < 0) return RandomContext::random_seed();
+    return (uint64_t)seed;
 }
 
-PYBIND11_MODULE(SpellingMaze, m) {
-    m.def("generate_maze", &generate_maze, "A function to generate a maze.");
+/**
+ * @brief Turn the image format and compression level passed in from Python into encoder options
+ */
+PngWriter::ImageOptions resolve_image_options(std::string image_format, int compression_level){
+    PngWriter::ImageFormat format;
+
+    if(compression_level < -1 || compression_level > 9){
+        throw py::value_error("compression_level must be between -1 and 9");
+    }
+
+    if(!PngWriter::get_image_format(image_format, format)){
+        throw py::value_error("Unknown image format '" + image_format + "', expected rgba, rgb, palette, gray8, gray2, gray1 or raw");
+    }
+
+    return PngWriter::ImageOptions(format, compression_level);
+}
+
+/**
+ * @brief The stats of the last call made from this thread
+ */
+Instrumentation::MazeStats& get_last_call_stats(){
+    static thread_local Instrumentation::MazeStats stats;
+    return stats;
+}
+
+/**
+ * @brief Start recording a call, replacing whatever the last call on this thread recorded
+ */
+Instrumentation::MazeStats* begin_call_stats(){
+    get_last_call_stats().clear();
+    return &get_last_call_stats();
+}
+
+py::dict stats_to_dict(Instrumentation::MazeStats &stats){
+    py::dict counters, phases;
+
+    for(int counter = 0; counter < Instrumentation::COUNTER_COUNT; counter++){
+        counters[Instrumentation::counter_names[counter]] = stats.counters[counter];
+    }
+    for(std::pair<std::string, int64_t> &phase_total: stats.get_phase_totals()){
+        phases[phase_total.first.c_str()] = phase_total.second;
+    }
+
+    py::dict ret;
+    ret["instrumented"] = Instrumentation::MazeStats::is_enabled();
+    ret["counters"] = counters;
+    ret["phases_ns"] = phases;
+    return ret;
+}
+
+py::dict get_last_stats(){
+    return stats_to_dict(get_last_call_stats());
+}
+
+void save_last_trace(std::string filename){
+    if(!VectorExport::save_file(filename, get_last_call_stats().to_chrome_trace())){
+        throw std::runtime_error("Couldn't write trace to '" + filename + "'");
+    }
+}
+
+/**
+ * @brief Draw letters with another font from now on, for every maze in the process
+ */
+void set_font(std::string filename){
+    if(!get_font_cache().load_font_from_file(filename)){
+        throw std::runtime_error("Couldn't load font from '" + filename + "'");
+    }
+}
+
+void set_font_data(py::bytes data){
+    std::string font_data(data);
+
+    if(!get_font_cache().load_font_from_memory((const uint8_t*) font_data.data(), font_data.size())){
+        throw py::value_error("Couldn't load a font from the given bytes");
+    }
+}
+
+/**
+ * @brief Turn the algorithm name passed in from Python into a generator type
+ */
+GeneratorType resolve_generator_type(std::string algorithm){
+    GeneratorType generator_type;
+
+    if(!get_generator_type(algorithm, generator_type)){
+        throw py::value_error("Unknown algorithm '" + algorithm + "', expected growing_tree, backtracker, wilson or kruskal");
+    }
+
+    return generator_type;
+}
+
+/**
+ * @brief Reject a word the grid can't hold before any maze is built for it
+ */
+void check_word_fits(std::string word, int grid_width, int grid_height){
+    if(!WordMaze::word_fits(word.length(), grid_width, grid_height)){
+        throw py::value_error("'" + word + "' doesn't fit in a " + std::to_string(grid_width) + "x" + std::to_string(grid_height) + " maze");
+    }
+}
+
+/**
+ * @brief Reject an image too large to draw before any maze is built for it
+ */
+void check_image_fits(int grid_width, int grid_height, int block_width, int block_height){
+    if(block_width < 1 || block_height < 1){
+        throw py::value_error("block_width and block_height must be at least 1");
+    }
+    if(!Drawable2D::is_valid_size((int64_t)grid_width * block_width, (int64_t)grid_height * block_height)){
+        throw py::value_error("A " + std::to_string(grid_width) + "x" + std::to_string(grid_height) + " maze with " + std::to_string(block_width) + "x" + std::to_string(block_height) + " blocks is too large to draw");
+    }
+}
+
+/**
+ * @brief Reject a grid too large to store before any maze is built for it
+ */
+void check_record_fits(int grid_width, int grid_height){
+    if(grid_width > MAZE_RECORD_MAX_GRID_SIZE || grid_height > MAZE_RECORD_MAX_GRID_SIZE || (int64_t)grid_width * grid_height > INT_MAX){
+        throw py::value_error("A " + std::to_string(grid_width) + "x" + std::to_string(grid_height) + " maze is too large to store");
+    }
+}
+
+/**
+ * @brief Build a word maze, on a skeleton from the pool when it is on and no seed was asked for.
+ * A pooled maze is still exactly the maze its recorded seed gives.
+ */
+WordMaze* create_word_maze(std::string word, int grid_width, int grid_height, int block_width, int block_height, int64_t seed, bool rasterize, GeneratorType generator_type){
+    if(seed < 0){
+        std::unique_ptr<Maze> skeleton = get_skeleton_pool().take(grid_width, grid_height, generator_type, word.length());
+        if(skeleton) return new WordMaze(word, *skeleton, block_width, block_height, rasterize);
+    }
+
+    return new WordMaze(word, grid_width, grid_height, block_width, block_height, resolve_seed(seed), rasterize, generator_type);
+}
+
+void set_skeleton_pool(int skeletons_per_size = 8, int threads = 1){
+    get_skeleton_pool().configure(skeletons_per_size, threads);
+}
+
+void generate_maze(std::string word, int grid_width, int grid_height, std::string file_prefix, int block_width = 20, int block_height = 20, int64_t seed = -1, std::string image_format = "rgba", int compression_level = -1, std::string algorithm = "growing_tree"){
+    PngWriter::ImageOptions options = resolve_image_options(image_format, compression_level);
+    check_word_fits(word, grid_width, grid_height);
+    check_image_fits(grid_width, grid_height, block_width, block_height);
+    Instrumentation::StatsScope stats_scope(begin_call_stats());
+    std::unique_ptr<WordMaze> m(create_word_maze(word, grid_width, grid_height, block_width, block_height, seed, true, resolve_generator_type(algorithm)));
+    std::string filename = file_prefix + word + PngWriter::get_file_extension(options.format);
+
+    if(!m->save_to_png(filename, options)) throw std::runtime_error("Couldn't write maze to '" + filename + "'");
+}
+
+void generate_mazes(std::vector<std::string> words, int grid_width, int grid_height, std::string file_prefix, int block_width = 20, int block_height = 20, int jobs = 0, int64_t seed = -1, std::string image_format = "rgba", int compression_level = -1, std::string algorithm = "growing_tree"){
+    PngWriter::ImageOptions options = resolve_image_options(image_format, compression_level);
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    for(std::string &word: words) check_word_fits(word, grid_width, grid_height);
+    check_image_fits(grid_width, grid_height, block_width, block_height);
+    uint64_t base_seed = resolve_seed(seed);
+    // A word listed twice is written to a numbered file, like the command line tool does
+    std::vector<std::string> filenames;
+    std::set<std::string> used_names;
+    for(std::string &word: words) filenames.push_back(file_prefix + claim_unused_name(word, used_names) + PngWriter::get_file_extension(options.format));
+    Instrumentation::MazeStats *batch_stats = begin_call_stats();
+    std::mutex stats_mutex;
+    ThreadPool pool(jobs);
+
+    pool.parallel_for(words.size(), [&](int word_index){
+        Instrumentation::MazeStats word_stats;
+        {
+            Instrumentation::StatsScope stats_scope(&word_stats);
+
+            // Every maze owns its random context, offsetting the seed by the word
+            // index keeps the batch reproducible without two mazes sharing a stream
+            WordMaze m(words[word_index], grid_width, grid_height, block_width, block_height, base_seed + word_index, true, generator_type);
+            // Thrown once the rest of the batch has been written, see ThreadPool::parallel_for
+            if(!m.save_to_png(filenames[word_index], options)) throw std::runtime_error("Couldn't write maze to '" + filenames[word_index] + "'");
+        }
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        batch_stats->merge(word_stats);
+    });
+}
+
+py::bytes generate_maze_png(std::string word, int grid_width, int grid_height, int block_width = 20, int block_height = 20, int64_t seed = -1, std::string image_format = "rgba", int compression_level = -1, std::string algorithm = "growing_tree"){
+    PngWriter::ImageOptions options = resolve_image_options(image_format, compression_level);
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    check_word_fits(word, grid_width, grid_height);
+    check_image_fits(grid_width, grid_height, block_width, block_height);
+    std::vector<uint8_t> png;
+    {
+        py::gil_scoped_release release;
+        Instrumentation::StatsScope stats_scope(begin_call_stats());
+        std::unique_ptr<WordMaze> m(create_word_maze(word, grid_width, grid_height, block_width, block_height, seed, true, generator_type));
+        png = m->encode_to_png(options);
+    }
+    return py::bytes((const char*) png.data(), png.size());
+}
+
+std::string generate_maze_svg(std::string word, int grid_width, int grid_height, int block_width = 20, int block_height = 20, int64_t seed = -1, std::string algorithm = "growing_tree"){
+    check_word_fits(word, grid_width, grid_height);
+    Instrumentation::StatsScope stats_scope(begin_call_stats());
+    std::unique_ptr<WordMaze> m(create_word_maze(word, grid_width, grid_height, block_width, block_height, seed, false, resolve_generator_type(algorithm)));
+    return VectorExport::encode_svg(m->map);
 }
 
+py::bytes generate_maze_pdf(std::string word, int grid_width, int grid_height, float block_size = 20, int64_t seed = -1, std::string algorithm = "growing_tree"){
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    check_word_fits(word, grid_width, grid_height);
+    std::vector<uint8_t> pdf;
+    {
+        py::gil_scoped_release release;
+        Instrumentation::StatsScope stats_scope(begin_call_stats());
+        std::unique_ptr<WordMaze> m(create_word_maze(word, grid_width, grid_height, 1, 1, seed, false, generator_type));
+        pdf = VectorExport::encode_pdf(m->map, block_size);
+    }
+    return py::bytes((const char*) pdf.data(), pdf.size());
+}
+
+void generate_poster_maze(int grid_width, int grid_height, std::string filename, int block_width = 4, int block_height = 4, int64_t seed = -1, std::string image_format = "rgba", int compression_level = -1){
+    PngWriter::ImageOptions options = resolve_image_options(image_format, compression_level);
+    if(!StreamingMaze::is_valid_size(grid_width, grid_height, block_width, block_height)){
+        throw py::value_error("A " + std::to_string(grid_width) + "x" + std::to_string(grid_height) + " poster maze with " + std::to_string(block_width) + "x" + std::to_string(block_height) + " blocks can't be drawn");
+    }
+    Instrumentation::StatsScope stats_scope(begin_call_stats());
+    StreamingMaze m(grid_width, grid_height, block_width, block_height, resolve_seed(seed));
+
+    if(!m.save_to_png(filename, options)) throw std::runtime_error("Couldn't write maze to '" + filename + "'");
+}
+
+/**
+ * @brief A rendered maze kept alive for Python, exposing its RGBA pixels through the buffer protocol
+ */
+struct MazeImage{
+    std::unique_ptr<WordMaze> maze;
+    // What generating the maze recorded
+    Instrumentation::MazeStats stats;
+
+    MazeImage(WordMaze *maze): maze(maze), stats(get_last_call_stats()){}
+
+    int get_width(){
+        return maze->map->width;
+    }
+
+    int get_height(){
+        return maze->map->height;
+    }
+
+    py::bytes to_png(std::string image_format = "rgba", int compression_level = -1){
+        PngWriter::ImageOptions options = resolve_image_options(image_format, compression_level);
+        std::vector<uint8_t> png;
+        {
+            py::gil_scoped_release release;
+            Instrumentation::StatsScope stats_scope(begin_call_stats());
+            png = maze->encode_to_png(options);
+        }
+        return py::bytes((const char*) png.data(), png.size());
+    }
+
+    py::bytes to_data(){
+        std::vector<uint8_t> data = maze->serialize();
+        return py::bytes((const char*) data.data(), data.size());
+    }
+};
+
+MazeImage* generate_maze_image(std::string word, int grid_width, int grid_height, int block_width = 20, int block_height = 20, int64_t seed = -1, std::string algorithm = "growing_tree"){
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    check_word_fits(word, grid_width, grid_height);
+    check_image_fits(grid_width, grid_height, block_width, block_height);
+    py::gil_scoped_release release;
+    Instrumentation::StatsScope stats_scope(begin_call_stats());
+    return new MazeImage(create_word_maze(word, grid_width, grid_height, block_width, block_height, seed, true, generator_type));
+}
+
+py::bytes generate_maze_data(std::string word, int grid_width, int grid_height, int64_t seed = -1, std::string algorithm = "growing_tree"){
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    check_word_fits(word, grid_width, grid_height);
+    check_record_fits(grid_width, grid_height);
+    std::vector<uint8_t> data;
+    {
+        py::gil_scoped_release release;
+        Instrumentation::StatsScope stats_scope(begin_call_stats());
+        std::unique_ptr<WordMaze> m(create_word_maze(word, grid_width, grid_height, 1, 1, seed, false, generator_type));
+        data = m->serialize();
+    }
+    return py::bytes((const char*) data.data(), data.size());
+}
+
+/**
+ * @brief Rebuild a maze saved with generate_maze_data, called without the GIL
+ */
+WordMaze* load_maze_data(const std::string &data, int block_width, int block_height, bool rasterize){
+    WordMaze *maze;
+
+    if(rasterize && (block_width < 1 || block_height < 1)) throw py::value_error("block_width and block_height must be at least 1");
+    // The grid size is only known once the data is read, so a maze too large to draw is caught as it's allocated
+    try{
+        maze = WordMaze::deserialize((const uint8_t*) data.data(), data.size(), block_width, block_height, rasterize);
+    }catch(std::length_error &error){
+        throw py::value_error(error.what());
+    }
 
+    if(!maze) throw py::value_error("The data isn't a valid maze");
+
+    return maze;
+}
+
+py::bytes maze_data_to_png(py::bytes data, int block_width = 20, int block_height = 20, std::string image_format = "rgba", int compression_level = -1){
+    PngWriter::ImageOptions options = resolve_image_options(image_format, compression_level);
+    std::string maze_data(data);
+    std::vector<uint8_t> png;
+    {
+        py::gil_scoped_release release;
+        Instrumentation::StatsScope stats_scope(begin_call_stats());
+        std::unique_ptr<WordMaze> m(load_maze_data(maze_data, block_width, block_height, true));
+        png = m->encode_to_png(options);
+    }
+    return py::bytes((const char*) png.data(), png.size());
+}
+
+std::string maze_data_to_svg(py::bytes data, int block_width = 20, int block_height = 20){
+    std::string maze_data(data);
+    Instrumentation::StatsScope stats_scope(begin_call_stats());
+    std::unique_ptr<WordMaze> m(load_maze_data(maze_data, block_width, block_height, false));
+    return VectorExport::encode_svg(m->map);
+}
+
+MazeImage* load_maze_image(py::bytes data, int block_width = 20, int block_height = 20){
+    std::string maze_data(data);
+    py::gil_scoped_release release;
+    Instrumentation::StatsScope stats_scope(begin_call_stats());
+    return new MazeImage(load_maze_data(maze_data, block_width, block_height, true));
+}
+
+/**
+ * @brief Generate a maze for every word and store them all in one archive, written in word order
+ * however the threads finish so a seeded archive is reproducible
+ */
+void generate_maze_archive(std::vector<std::string> words, int grid_width, int grid_height, std::string filename, int jobs = 0, int64_t seed = -1, std::string algorithm = "growing_tree"){
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    for(std::string &word: words) check_word_fits(word, grid_width, grid_height);
+    check_record_fits(grid_width, grid_height);
+    uint64_t base_seed = resolve_seed(seed);
+    std::vector<std::vector<uint8_t>> records(words.size());
+    Instrumentation::MazeStats *batch_stats = begin_call_stats();
+    std::mutex stats_mutex;
+    {
+        ThreadPool pool(jobs);
+
+        // A maze that throws is rethrown here once the rest are done, before anything is written
+        pool.parallel_for(words.size(), [&](int word_index){
+            Instrumentation::MazeStats word_stats;
+            {
+                Instrumentation::StatsScope stats_scope(&word_stats);
+                WordMaze m(words[word_index], grid_width, grid_height, 1, 1, base_seed + word_index, false, generator_type);
+                records[word_index] = m.serialize();
+            }
+
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            batch_stats->merge(word_stats);
+        });
+    }
+
+    MazeFormat::MazeArchiveWriter writer;
+    if(writer.open(filename)){
+        for(size_t word_index = 0; word_index < words.size(); word_index++){
+            writer.add(words[word_index], records[word_index]);
+        }
+    }
+    if(!writer.close()) throw std::runtime_error("Couldn't write maze archive to '" + filename + "'");
+}
+
+MazeFormat::MazeArchive* open_maze_archive(std::string filename){
+    std::unique_ptr<MazeFormat::MazeArchive> archive(new MazeFormat::MazeArchive());
+
+    if(!archive->open(filename)) throw std::runtime_error("Couldn't open maze archive '" + filename + "'");
+
+    return archive.release();
+}
+
+py::bytes get_archive_record(MazeFormat::MazeArchive &archive, std::string word){
+    int entry = archive.find(word);
+    size_t record_size;
+
+    if(entry == -1) throw py::key_error(word);
+
+    const uint8_t *record = archive.get_record(entry, record_size);
+    return py::bytes((const char*) record, record_size);
+}
+
+/**
+ * @brief The worker threads submit_* calls run on. They live as long as the module, separate from
+ * the pools generate_mazes makes per call, so a queued request never waits behind a batch.
+ */
+std::mutex async_pool_mutex;
+std::unique_ptr<ThreadPool> async_pool;
+int async_thread_count = 0;
+// Tokens of every request that hasn't finished, so shutdown can stop them
+std::unordered_set<Cancellation::Token*> async_tokens;
+// SpellingMaze.MazeFuture, only a handle so nothing is released after the interpreter is gone
+py::handle maze_future_class;
+
+ThreadPool& get_async_pool(){
+    std::lock_guard<std::mutex> lock(async_pool_mutex);
+
+    if(!async_pool) async_pool.reset(new ThreadPool(async_thread_count));
+    return *async_pool;
+}
+
+/**
+ * @brief Resize the async workers, requests already queued finish on the old ones first
+ */
+void set_async_workers(int count){
+    std::unique_ptr<ThreadPool> old_pool;
+    {
+        std::lock_guard<std::mutex> lock(async_pool_mutex);
+        async_thread_count = count;
+        old_pool = std::move(async_pool);
+    }
+
+    // Workers need the GIL to hand over their results, so it can't be held while they're joined
+    py::gil_scoped_release release;
+    old_pool.reset();
+}
+
+/**
+ * @brief Cancel everything still queued or running and stop the workers, run at interpreter exit
+ */
+void shutdown_async_workers(){
+    {
+        std::lock_guard<std::mutex> lock(async_pool_mutex);
+        for(Cancellation::Token *token: async_tokens) token->cancel();
+    }
+
+    set_async_workers(0);
+}
+
+/**
+ * @brief A request waiting on or running in the async workers. The future is only touched with
+ * the GIL held and is cleared once resolved, so the request can be freed from any thread.
+ */
+struct AsyncRequest{
+    py::object future;
+    std::shared_ptr<Cancellation::Token> token;
+};
+
+/**
+ * @brief Queue work on the async workers and return a MazeFuture for it
+ *
+ * @param work Runs on a worker without the GIL, cancelled through the future's token
+ * @param to_python Turns the result into the future's result, with the GIL held
+ * @return py::object The MazeFuture
+ */
+template<typename Result>
+py::object submit_async(std::function<Result()> work, std::function<py::object(Result&)> to_python){
+    std::shared_ptr<AsyncRequest> request(new AsyncRequest());
+
+    request->token.reset(new Cancellation::Token());
+    request->future = maze_future_class(request->token);
+    {
+        std::lock_guard<std::mutex> lock(async_pool_mutex);
+        async_tokens.insert(request->token.get());
+    }
+
+    get_async_pool().submit([request, work, to_python]{
+        Result result;
+        std::string error;
+        bool started = false;
+        Instrumentation::MazeStats stats;
+        {
+            py::gil_scoped_acquire gil;
+            // Failing to start still resolves the future below, or whoever waits on it never returns
+            try{
+                started = request->future.attr("set_running_or_notify_cancel")().cast<bool>();
+            }catch(py::error_already_set &exception){
+                error = exception.what();
+            }
+        }
+
+        if(started && !request->token->is_cancelled()){
+            Cancellation::TokenScope token_scope(request->token.get());
+            Instrumentation::StatsScope stats_scope(begin_call_stats());
+
+            try{
+                result = work();
+            }catch(std::exception &exception){
+                error = exception.what();
+            }
+            // The worker's own last stats are out of the caller's reach, so they go on the future
+            stats = get_last_call_stats();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(async_pool_mutex);
+            async_tokens.erase(request->token.get());
+        }
+
+        py::gil_scoped_acquire gil;
+        // A Python error can't be allowed out of a worker thread, it would take the process down
+        try{
+            request->future.attr("stats") = stats_to_dict(stats);
+            if(started || !error.empty()){
+                if(request->token->is_cancelled()){
+                    request->future.attr("set_exception")(py::module_::import("concurrent.futures").attr("CancelledError")());
+                }else if(!error.empty()){
+                    request->future.attr("set_exception")(py::module_::import("builtins").attr("RuntimeError")(error));
+                }else{
+                    request->future.attr("set_result")(to_python(result));
+                }
+            }
+        }catch(py::error_already_set&){}
+        request->future = py::object();
+    });
+
+    return request->future;
+}
+
+py::object submit_maze(std::string word, int grid_width, int grid_height, std::string file_prefix, int block_width = 20, int block_height = 20, int64_t seed = -1, std::string image_format = "rgba", int compression_level = -1, std::string algorithm = "growing_tree"){
+    PngWriter::ImageOptions options = resolve_image_options(image_format, compression_level);
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    std::string filename = file_prefix + word + PngWriter::get_file_extension(options.format);
+    check_word_fits(word, grid_width, grid_height);
+    check_image_fits(grid_width, grid_height, block_width, block_height);
+
+    return submit_async<std::string>([=]{
+        std::unique_ptr<WordMaze> m(create_word_maze(word, grid_width, grid_height, block_width, block_height, seed, true, generator_type));
+        if(!Cancellation::is_cancelled() && !m->save_to_png(filename, options)) throw std::runtime_error("Couldn't write maze to '" + filename + "'");
+        return filename;
+    }, [](std::string &filename){
+        return py::str(filename);
+    });
+}
+
+py::object submit_maze_png(std::string word, int grid_width, int grid_height, int block_width = 20, int block_height = 20, int64_t seed = -1, std::string image_format = "rgba", int compression_level = -1, std::string algorithm = "growing_tree"){
+    PngWriter::ImageOptions options = resolve_image_options(image_format, compression_level);
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    check_word_fits(word, grid_width, grid_height);
+    check_image_fits(grid_width, grid_height, block_width, block_height);
+
+    return submit_async<std::vector<uint8_t>>([=]{
+        std::unique_ptr<WordMaze> m(create_word_maze(word, grid_width, grid_height, block_width, block_height, seed, true, generator_type));
+        return m->encode_to_png(options);
+    }, [](std::vector<uint8_t> &png){
+        return py::bytes((const char*) png.data(), png.size());
+    });
+}
+
+py::object submit_maze_image(std::string word, int grid_width, int grid_height, int block_width = 20, int block_height = 20, int64_t seed = -1, std::string algorithm = "growing_tree"){
+    GeneratorType generator_type = resolve_generator_type(algorithm);
+    check_word_fits(word, grid_width, grid_height);
+    check_image_fits(grid_width, grid_height, block_width, block_height);
+
+    return submit_async<std::unique_ptr<MazeImage>>([=]{
+        return std::unique_ptr<MazeImage>(new MazeImage(create_word_maze(word, grid_width, grid_height, block_width, block_height, seed, true, generator_type)));
+    }, [](std::unique_ptr<MazeImage> &image){
+        return py::cast(image.release(), py::return_value_policy::take_ownership);
+    });
+}
+
+PYBIND11_MODULE(SpellingMaze, m) {
+    m.def("generate_maze", &generate_maze, "A function to generate a maze.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"), py::arg("file_prefix"),
+          py::arg("block_width") = 20, py::arg("block_height") = 20, py::arg("seed") = -1,
+          py::arg("image_format") = "rgba", py::arg("compression_level") = -1, py::arg("algorithm") = "growing_tree");
+    m.def("generate_mazes", &generate_mazes, "A function to generate a maze for every word in a list, spread across a pool of threads.",
+          py::arg("words"), py::arg("grid_width"), py::arg("grid_height"), py::arg("file_prefix"),
+          py::arg("block_width") = 20, py::arg("block_height") = 20, py::arg("jobs") = 0, py::arg("seed") = -1,
+          py::arg("image_format") = "rgba", py::arg("compression_level") = -1, py::arg("algorithm") = "growing_tree",
+          py::call_guard<py::gil_scoped_release>());
+    m.def("generate_maze_png", &generate_maze_png, "A function to generate a maze and return it as PNG encoded bytes.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"),
+          py::arg("block_width") = 20, py::arg("block_height") = 20, py::arg("seed") = -1,
+          py::arg("image_format") = "rgba", py::arg("compression_level") = -1, py::arg("algorithm") = "growing_tree");
+    m.def("generate_maze_image", &generate_maze_image, "A function to generate a maze and return its pixels, usable as a (height, width, 4) uint8 array.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"),
+          py::arg("block_width") = 20, py::arg("block_height") = 20, py::arg("seed") = -1, py::arg("algorithm") = "growing_tree");
+    m.def("generate_maze_svg", &generate_maze_svg, "A function to generate a maze as an SVG document, drawn from the maze walls without rasterizing.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"),
+          py::arg("block_width") = 20, py::arg("block_height") = 20, py::arg("seed") = -1, py::arg("algorithm") = "growing_tree",
+          py::call_guard<py::gil_scoped_release>());
+    m.def("generate_maze_pdf", &generate_maze_pdf, "A function to generate a maze as a single page PDF, drawn from the maze walls without rasterizing.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"),
+          py::arg("block_size") = 20.0f, py::arg("seed") = -1, py::arg("algorithm") = "growing_tree");
+    m.def("generate_poster_maze", &generate_poster_maze, "A function to generate a plain maze of any size without a word, streamed to the file a row at a time so memory only grows with the width.",
+          py::arg("grid_width"), py::arg("grid_height"), py::arg("filename"),
+          py::arg("block_width") = 4, py::arg("block_height") = 4, py::arg("seed") = -1,
+          py::arg("image_format") = "rgba", py::arg("compression_level") = -1,
+          py::call_guard<py::gil_scoped_release>());
+    m.def("get_last_stats", &get_last_stats, "Get the phase times and counters recorded by the last call made from this thread, empty unless the module was built with SPELLING_MAZE_INSTRUMENTATION.");
+    m.def("save_last_trace", &save_last_trace, "Save the phases recorded by the last call made from this thread as Chrome trace event JSON.",
+          py::arg("filename"));
+    m.def("set_font", &set_font, "Load a TrueType or OpenType font file to draw letters with, in place of the built in font, for every maze made afterwards.",
+          py::arg("filename"));
+    m.def("set_font_data", &set_font_data, "Load a font to draw letters with from the bytes of a font file, for every maze made afterwards.",
+          py::arg("data"));
+
+    py::class_<MazeImage>(m, "MazeImage", py::buffer_protocol())
+        .def_buffer([](MazeImage &image) -> py::buffer_info {
+            Map *map = image.maze->map;
+            return py::buffer_info(
+                map->pixels,
+                sizeof(uint8_t),
+                py::format_descriptor<uint8_t>::format(),
+                3,
+                {map->height, map->width, PIXEL_CHANNELS},
+                {(py::ssize_t) map->get_row_stride(), PIXEL_CHANNELS, 1}
+            );
+        })
+        .def_property_readonly("width", &MazeImage::get_width)
+        .def_property_readonly("height", &MazeImage::get_height)
+        .def_property_readonly("distance_field", [](MazeImage &image){ return image.maze->distance_from_start; },
+                               "Steps from the start to every block in row major order, -1 where a block can't be reached.")
+        .def_property_readonly("solution_length", [](MazeImage &image){ return image.maze->solution_path ? image.maze->solution_path->curr_path_len : 0; },
+                               "Number of blocks on the solution path.")
+        .def_property_readonly("stats", [](MazeImage &image){ return stats_to_dict(image.stats); },
+                               "Phase times and counters recorded while the maze was generated.")
+        .def("to_png", &MazeImage::to_png, "Encode the maze as PNG bytes.",
+             py::arg("image_format") = "rgba", py::arg("compression_level") = -1)
+        .def("to_data", &MazeImage::to_data, "Get the maze in the compact stored form generate_maze_data returns.");
+
+    m.def("generate_maze_data", &generate_maze_data, "A function to generate a maze and return it in the compact stored form, which load_maze_image, maze_data_to_png and maze_data_to_svg draw without generating it again.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"), py::arg("seed") = -1, py::arg("algorithm") = "growing_tree");
+    m.def("maze_data_to_png", &maze_data_to_png, "Draw a stored maze as PNG encoded bytes.",
+          py::arg("data"), py::arg("block_width") = 20, py::arg("block_height") = 20,
+          py::arg("image_format") = "rgba", py::arg("compression_level") = -1);
+    m.def("maze_data_to_svg", &maze_data_to_svg, "Draw a stored maze as an SVG document.",
+          py::arg("data"), py::arg("block_width") = 20, py::arg("block_height") = 20);
+    m.def("load_maze_image", &load_maze_image, "Draw a stored maze and return its pixels, like generate_maze_image.",
+          py::arg("data"), py::arg("block_width") = 20, py::arg("block_height") = 20);
+    m.def("generate_maze_archive", &generate_maze_archive, "A function to generate a maze for every word in a list and store them all in one archive file, spread across a pool of threads.",
+          py::arg("words"), py::arg("grid_width"), py::arg("grid_height"), py::arg("filename"),
+          py::arg("jobs") = 0, py::arg("seed") = -1, py::arg("algorithm") = "growing_tree",
+          py::call_guard<py::gil_scoped_release>());
+
+    py::class_<MazeFormat::MazeArchive>(m, "MazeArchive")
+        .def(py::init(&open_maze_archive), "Map an archive written by generate_maze_archive.", py::arg("filename"))
+        .def("__len__", &MazeFormat::MazeArchive::get_entry_count)
+        .def("__contains__", [](MazeFormat::MazeArchive &archive, std::string word){ return archive.find(word) != -1; })
+        .def("__getitem__", &get_archive_record)
+        .def("get", &get_archive_record, "Get the stored maze for a word, raises KeyError if the archive doesn't have it.",
+             py::arg("word"))
+        .def("words", [](MazeFormat::MazeArchive &archive){
+            std::vector<std::string> words;
+            for(int entry = 0; entry < archive.get_entry_count(); entry++) words.push_back(archive.get_word(entry));
+            return words;
+        }, "Every word in the archive, sorted.")
+        .def("close", &MazeFormat::MazeArchive::close);
+
+    py::class_<Cancellation::Token, std::shared_ptr<Cancellation::Token>>(m, "CancellationToken")
+        .def(py::init<>())
+        .def("cancel", &Cancellation::Token::cancel, "Ask the maze to stop, it checks between and inside every phase.")
+        .def_property_readonly("cancelled", &Cancellation::Token::is_cancelled);
+
+    py::exec(R"(
+import concurrent.futures
+
+class MazeFuture(concurrent.futures.Future):
+    """A concurrent.futures.Future for a maze generating on the module's worker threads, await it
+    with asyncio.wrap_future. Cancelling it also stops a maze that has already started, the future
+    then raises CancelledError. Once it's done, stats holds what get_last_stats would have
+    returned had the maze been generated on the calling thread."""
+
+    def __init__(self, token):
+        super().__init__()
+        self.token = token
+        self.stats = None
+
+    def cancel(self):
+        self.token.cancel()
+        return super().cancel()
+)", m.attr("__dict__"));
+    maze_future_class = m.attr("MazeFuture");
+    maze_future_class.inc_ref();
+
+    m.def("submit_maze", &submit_maze, "Queue a maze to be written to a file on the module's worker threads, returns a MazeFuture for the filename.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"), py::arg("file_prefix"),
+          py::arg("block_width") = 20, py::arg("block_height") = 20, py::arg("seed") = -1,
+          py::arg("image_format") = "rgba", py::arg("compression_level") = -1, py::arg("algorithm") = "growing_tree");
+    m.def("submit_maze_png", &submit_maze_png, "Queue a maze on the module's worker threads, returns a MazeFuture for its PNG bytes.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"),
+          py::arg("block_width") = 20, py::arg("block_height") = 20, py::arg("seed") = -1,
+          py::arg("image_format") = "rgba", py::arg("compression_level") = -1, py::arg("algorithm") = "growing_tree");
+    m.def("submit_maze_image", &submit_maze_image, "Queue a maze on the module's worker threads, returns a MazeFuture for its MazeImage.",
+          py::arg("word"), py::arg("grid_width"), py::arg("grid_height"),
+          py::arg("block_width") = 20, py::arg("block_height") = 20, py::arg("seed") = -1, py::arg("algorithm") = "growing_tree");
+    m.def("set_skeleton_pool", &set_skeleton_pool, "Keep solved mazes ready for calls without a seed, generated on background threads. Turns on with skeletons_per_size mazes for each grid size and algorithm in use, 0 turns it off.",
+          py::arg("skeletons_per_size") = 8, py::arg("threads") = 1,
+          py::call_guard<py::gil_scoped_release>());
+    m.def("set_async_workers", &set_async_workers, "Set how many worker threads the submit calls run on, 0 uses one per core. Requests already queued finish first.",
+          py::arg("count") = 0);
+
+    py::module_::import("atexit").attr("register")(py::cpp_function(&shutdown_async_workers));
+}
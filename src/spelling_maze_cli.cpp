@@ -0,0 +1,362 @@
+#include "../include/map.hpp"
+#include "../include/maze_archive.hpp"
+#include "../include/thread_pool.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Everything the command line can set, defaulting to what the Python module uses
+ */
+struct CliOptions{
+    std::string word_file, output_directory, image_format, algorithm, font_file, archive_file, source_archive_file;
+    int64_t grid_width, grid_height, block_width, block_height, jobs, compression_level, seed;
+    bool show_help, has_word_file;
+
+    CliOptions(): word_file("-"), output_directory("."), image_format("rgba"), algorithm("growing_tree"), grid_width(20), grid_height(20), block_width(20), block_height(20), jobs(0), compression_level(-1), seed(-1), show_help(false), has_word_file(false){}
+};
+
+static void print_usage(FILE *out){
+    fprintf(out,
+        "Usage: spelling_maze [options] [word_file]\n"
+        "Writes a spelling maze for every word in word_file, one word per line, reading stdin when\n"
+        "word_file is missing or '-'. Blank lines and lines starting with # are skipped.\n"
+        "\n"
+        "  -o, --output DIR         Directory to write the mazes to, created if needed (default .)\n"
+        "      --grid-width N       Maze width in blocks (default 20)\n"
+        "      --grid-height N      Maze height in blocks (default 20)\n"
+        "      --block-width N      Block width in pixels (default 20)\n"
+        "      --block-height N     Block height in pixels (default 20)\n"
+        "  -s, --seed N             Seed for the batch, each word gets seed + its index among\n"
+        "                           the words read, so skipped lines don't count (default random)\n"
+        "  -j, --jobs N             Worker threads, 0 uses one per core (default 0)\n"
+        "      --format NAME        rgba, rgb, palette, gray8, gray2, gray1 or raw (default rgba)\n"
+        "      --compression N      zlib level from 0 to 9, -1 for zlib's default (default -1)\n"
+        "      --algorithm NAME     growing_tree, backtracker, wilson or kruskal (default growing_tree)\n"
+        "      --font FILE          Draw letters with this font instead of the built in one\n"
+        "      --archive FILE       Store the mazes in one archive file instead of drawing them\n"
+        "      --from-archive FILE  Draw the mazes stored in an archive instead of generating them,\n"
+        "                           every maze in it unless a word file is given\n"
+        "  -h, --help               Show this message\n");
+}
+
+static bool parse_integer(std::string text, int64_t &value){
+    char *end = NULL;
+
+    if(text.empty()) return false;
+
+    value = strtoll(text.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+/**
+ * @brief Read the arguments into options, taking both '--name value' and '--name=value'
+ *
+ * @return true The arguments were valid
+ * @return false error says what was wrong
+ */
+static bool parse_arguments(int argc, char **argv, CliOptions &options, std::string &error){
+    static const std::pair<const char*, int64_t CliOptions::*> integer_options[] = {
+        {"--grid-width", &CliOptions::grid_width}, {"--grid-height", &CliOptions::grid_height},
+        {"--block-width", &CliOptions::block_width}, {"--block-height", &CliOptions::block_height},
+        {"--seed", &CliOptions::seed}, {"-s", &CliOptions::seed},
+        {"--jobs", &CliOptions::jobs}, {"-j", &CliOptions::jobs},
+        {"--compression", &CliOptions::compression_level}
+    };
+    static const std::pair<const char*, std::string CliOptions::*> string_options[] = {
+        {"--output", &CliOptions::output_directory}, {"-o", &CliOptions::output_directory},
+        {"--format", &CliOptions::image_format}, {"--algorithm", &CliOptions::algorithm},
+        {"--font", &CliOptions::font_file}, {"--archive", &CliOptions::archive_file},
+        {"--from-archive", &CliOptions::source_archive_file}
+    };
+
+    for(int arg_index = 1; arg_index < argc; arg_index++){
+        std::string arg = argv[arg_index], value;
+        bool has_inline_value = false;
+        bool matched = false;
+
+        if(arg == "-h" || arg == "--help"){
+            options.show_help = true;
+            return true;
+        }
+
+        if(arg.size() < 2 || arg[0] != '-'){
+            if(options.has_word_file){
+                error = "Only one word file can be given";
+                return false;
+            }
+            options.word_file = arg;
+            options.has_word_file = true;
+            continue;
+        }
+
+        size_t equals = arg.find('=');
+        if(arg.compare(0, 2, "--") == 0 && equals != std::string::npos){
+            value = arg.substr(equals + 1);
+            arg = arg.substr(0, equals);
+            has_inline_value = true;
+        }
+
+        for(const std::pair<const char*, int64_t CliOptions::*> &option: integer_options){
+            if(arg != option.first) continue;
+
+            if(!has_inline_value){
+                if(arg_index + 1 >= argc){
+                    error = arg + " needs a value";
+                    return false;
+                }
+                value = argv[++arg_index];
+            }
+            if(!parse_integer(value, options.*option.second)){
+                error = arg + " needs a whole number, got '" + value + "'";
+                return false;
+            }
+            matched = true;
+        }
+
+        for(const std::pair<const char*, std::string CliOptions::*> &option: string_options){
+            if(arg != option.first) continue;
+
+            if(!has_inline_value){
+                if(arg_index + 1 >= argc){
+                    error = arg + " needs a value";
+                    return false;
+                }
+                value = argv[++arg_index];
+            }
+            options.*option.second = value;
+            matched = true;
+        }
+
+        if(!matched){
+            error = "Unknown option '" + arg + "'";
+            return false;
+        }
+    }
+
+    if(options.grid_width < 1 || options.grid_height < 1 || options.block_width < 1 || options.block_height < 1){
+        error = "Grid and block sizes must be at least 1";
+        return false;
+    }
+    // Blocks are indexed with an int, and a maze record can't store a side over MAZE_RECORD_MAX_GRID_SIZE
+    if(options.grid_width > MAZE_RECORD_MAX_GRID_SIZE || options.grid_height > MAZE_RECORD_MAX_GRID_SIZE || options.grid_width * options.grid_height > INT_MAX){
+        error = "A " + std::to_string(options.grid_width) + "x" + std::to_string(options.grid_height) + " grid has too many blocks";
+        return false;
+    }
+    // Only drawn mazes use the block size, an archive stores the grid alone
+    if(options.archive_file.empty() && (options.block_width > INT_MAX || options.block_height > INT_MAX ||
+        !Drawable2D::is_valid_size(options.grid_width * options.block_width, options.grid_height * options.block_height))){
+        error = "A " + std::to_string(options.grid_width) + "x" + std::to_string(options.grid_height) + " maze with " + std::to_string(options.block_width) + "x" + std::to_string(options.block_height) + " blocks is too large to draw";
+        return false;
+    }
+    if(options.compression_level < -1 || options.compression_level > 9){
+        error = "--compression must be between -1 and 9";
+        return false;
+    }
+    if(!options.archive_file.empty() && !options.source_archive_file.empty()){
+        error = "--archive and --from-archive can't be used together";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read one word per line, trimming whitespace and skipping blank lines and comments
+ */
+static std::vector<std::string> read_words(std::istream &input){
+    std::vector<std::string> words;
+    std::string line;
+
+    while(std::getline(input, line)){
+        size_t first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#') continue;
+
+        size_t last = line.find_last_not_of(" \t\r");
+        words.push_back(line.substr(first, last - first + 1));
+    }
+
+    return words;
+}
+
+int main(int argc, char **argv){
+    CliOptions options;
+    std::string error;
+    PngWriter::ImageFormat image_format;
+    GeneratorType generator_type;
+
+    if(!parse_arguments(argc, argv, options, error)){
+        fprintf(stderr, "spelling_maze: %s\n\n", error.c_str());
+        print_usage(stderr);
+        return 2;
+    }
+    if(options.show_help){
+        print_usage(stdout);
+        return 0;
+    }
+    if(!PngWriter::get_image_format(options.image_format, image_format)){
+        fprintf(stderr, "spelling_maze: Unknown format '%s', expected rgba, rgb, palette, gray8, gray2, gray1 or raw\n", options.image_format.c_str());
+        return 2;
+    }
+    if(!get_generator_type(options.algorithm, generator_type)){
+        fprintf(stderr, "spelling_maze: Unknown algorithm '%s', expected growing_tree, backtracker, wilson or kruskal\n", options.algorithm.c_str());
+        return 2;
+    }
+
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    // Storing mazes in an archive skips drawing them, so it never needs the font or output directory
+    bool draws_images = options.archive_file.empty();
+
+    // Load the font up front, so a bad font fails once instead of in every worker
+    if(draws_images && !options.font_file.empty() && !get_font_cache().load_font_from_file(options.font_file)){
+        fprintf(stderr, "spelling_maze: Couldn't load font from '%s'\n", options.font_file.c_str());
+        return 1;
+    }
+    if(draws_images && !get_font_cache().get_glyph_atlas(options.block_width, options.block_height)){
+        fprintf(stderr, "spelling_maze: Couldn't load the font\n");
+        return 1;
+    }
+
+    MazeFormat::MazeArchive source_archive;
+    if(!options.source_archive_file.empty() && !source_archive.open(options.source_archive_file)){
+        fprintf(stderr, "spelling_maze: Couldn't open archive '%s'\n", options.source_archive_file.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> words;
+    if(source_archive.is_open() && !options.has_word_file){
+        for(int entry = 0; entry < source_archive.get_entry_count(); entry++){
+            words.push_back(source_archive.get_word(entry));
+        }
+    }
+    else if(options.word_file == "-"){
+        words = read_words(std::cin);
+    }
+    else{
+        std::ifstream word_stream(options.word_file);
+        if(!word_stream){
+            fprintf(stderr, "spelling_maze: Couldn't open word file '%s'\n", options.word_file.c_str());
+            return 1;
+        }
+        words = read_words(word_stream);
+    }
+
+    std::error_code directory_error;
+    if(draws_images) std::filesystem::create_directories(options.output_directory, directory_error);
+    if(directory_error){
+        fprintf(stderr, "spelling_maze: Couldn't create '%s': %s\n", options.output_directory.c_str(), directory_error.message().c_str());
+        return 1;
+    }
+
+    // Words that can't become a maze are reported and skipped, the rest of the batch still runs
+    std::vector<int> valid_words;
+    // A word listed twice gets a numbered file name, so two workers never write the same file
+    std::vector<std::string> output_names(words.size());
+    std::set<std::string> used_names;
+    int failed_count = 0;
+    for(size_t word_index = 0; word_index < words.size(); word_index++){
+        std::string &word = words[word_index];
+
+        if(draws_images && word.find_first_of("/\\") != std::string::npos){
+            fprintf(stderr, "spelling_maze: Skipping '%s', words can't contain path separators\n", word.c_str());
+            failed_count++;
+        }
+        else if(source_archive.is_open() && source_archive.find(word) == -1){
+            fprintf(stderr, "spelling_maze: Skipping '%s', it isn't in the archive\n", word.c_str());
+            failed_count++;
+        }
+        else if(!source_archive.is_open() && !WordMaze::word_fits(word.length(), options.grid_width, options.grid_height)){
+            fprintf(stderr, "spelling_maze: Skipping '%s', it doesn't fit in a %dx%d maze\n", word.c_str(), (int)options.grid_width, (int)options.grid_height);
+            failed_count++;
+        }
+        else if(!draws_images && used_names.count(word)){
+            fprintf(stderr, "spelling_maze: Skipping '%s', it's already in the archive\n", word.c_str());
+            failed_count++;
+        }
+        else{
+            std::string &name = output_names[word_index];
+            name = claim_unused_name(word, used_names);
+            if(name != word) fprintf(stderr, "spelling_maze: '%s' would share a file with another word, writing it as '%s'\n", word.c_str(), name.c_str());
+
+            valid_words.push_back(word_index);
+        }
+    }
+
+    PngWriter::ImageOptions image_options(image_format, options.compression_level);
+    uint64_t base_seed = options.seed < 0 ? RandomContext::random_seed() : (uint64_t)options.seed;
+    std::vector<std::vector<uint8_t>> records(draws_images ? 0 : words.size());
+    std::mutex report_mutex;
+    {
+        ThreadPool pool(options.jobs);
+
+        pool.parallel_for(valid_words.size(), [&](int valid_index){
+            int word_index = valid_words[valid_index];
+            std::string &word = words[word_index];
+
+            // Anything thrown on a pool thread is reported here for its word rather than ending the batch
+            try{
+                // Seeded by the index among the words read like SpellingMaze.generate_mazes, so a batch is reproducible
+                if(!draws_images){
+                    WordMaze maze(word, options.grid_width, options.grid_height, 1, 1, base_seed + word_index, false, generator_type);
+                    records[word_index] = maze.serialize();
+                    return;
+                }
+
+                std::filesystem::path filename = std::filesystem::path(options.output_directory) / (output_names[word_index] + PngWriter::get_file_extension(image_format));
+                std::unique_ptr<WordMaze> maze;
+                if(source_archive.is_open()){
+                    size_t record_size;
+                    const uint8_t *record = source_archive.get_record(source_archive.find(word), record_size);
+                    maze.reset(WordMaze::deserialize(record, record_size, options.block_width, options.block_height));
+                }
+                else{
+                    maze.reset(new WordMaze(word, options.grid_width, options.grid_height, options.block_width, options.block_height, base_seed + word_index, true, generator_type));
+                }
+
+                if(!maze){
+                    std::lock_guard<std::mutex> lock(report_mutex);
+                    fprintf(stderr, "spelling_maze: Couldn't read '%s' from the archive, it's damaged\n", word.c_str());
+                    failed_count++;
+                }
+                else if(!maze->save_to_png(filename.string(), image_options)){
+                    std::lock_guard<std::mutex> lock(report_mutex);
+                    fprintf(stderr, "spelling_maze: Couldn't write '%s'\n", filename.string().c_str());
+                    failed_count++;
+                }
+            }catch(std::exception &exception){
+                std::lock_guard<std::mutex> lock(report_mutex);
+                fprintf(stderr, "spelling_maze: Couldn't %s '%s': %s\n", draws_images ? "draw" : "store", word.c_str(), exception.what());
+                failed_count++;
+            }
+        });
+    }
+
+    // Written in word order once every maze is done, so a seeded archive is reproducible
+    if(!draws_images){
+        MazeFormat::MazeArchiveWriter writer;
+        if(writer.open(options.archive_file)){
+            // A word that failed has no record and was already reported
+            for(int word_index: valid_words){
+                if(!records[word_index].empty()) writer.add(words[word_index], records[word_index]);
+            }
+        }
+        if(!writer.close()){
+            fprintf(stderr, "spelling_maze: Couldn't write archive '%s'\n", options.archive_file.c_str());
+            return 1;
+        }
+    }
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    std::string destination = draws_images ? options.output_directory : options.archive_file;
+    printf("Wrote %d of %d mazes to %s in %.1f ms\n", (int)words.size() - failed_count, (int)words.size(), destination.c_str(), elapsed_ms);
+
+    return failed_count > 0 ? 1 : 0;
+}
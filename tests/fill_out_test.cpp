@@ -0,0 +1,44 @@
+#include "test_mazes.hpp"
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief Every generator, over grids from 2 blocks wide up and words from one letter to as many as
+ * fit, should leave every block of the grid in the maze and the word spelled along the solution path
+ */
+int main(){
+    const int sizes[] = {2, 3, 5, 8, 13};
+    int failures = 0, maze_count = 0;
+
+    for(GeneratorType generator_type: generator_types){
+        for(int grid_width: sizes){
+            for(int grid_height: sizes){
+                bool vertical;
+                int max_length = WordMaze::get_comb_junction_count(grid_width, grid_height, vertical);
+                const int lengths[] = {1, 2, 3, max_length / 2, max_length};
+
+                for(int length: lengths){
+                    if(length < 1 || length > max_length) continue;
+
+                    std::string word;
+                    for(int letter = 0; letter < length; letter++) word += 'a' + (letter * 7 + grid_width) % 26;
+
+                    for(int seed = 0; seed < 6; seed++){
+                        WordMaze maze(word, grid_width, grid_height, 1, 1, seed, false, generator_type);
+                        maze_count++;
+
+                        int unexplored = maze.get_unexplored_block_count();
+                        std::string read = read_word(maze);
+                        if(unexplored == 0 && read == word) continue;
+
+                        fprintf(stderr, "generator %d, %dx%d, \"%s\", seed %d: %d unexplored blocks, read \"%s\"\n", generator_type, grid_width, grid_height, word.c_str(), seed, unexplored, read.c_str());
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("%d of %d mazes failed\n", failures, maze_count);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+#include "../include/maze_archive.hpp"
+#include "test_mazes.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A stored maze should read back into the same maze, drawing to the same image, and
+ * damaged data should be turned away rather than read
+ */
+static int check_round_trips(int &maze_count){
+    const int sizes[] = {1, 2, 7, 20};
+    const std::string words[] = {"", "a", "maze", "spelling"};
+    PngWriter::ImageOptions options(PngWriter::RGBA, 1);
+    int failures = 0;
+
+    for(GeneratorType generator_type: generator_types){
+        for(int grid_width: sizes){
+            for(int grid_height: sizes){
+                for(const std::string &word: words){
+                    if(!WordMaze::word_fits(word.length(), grid_width, grid_height)) continue;
+
+                    for(int seed = 0; seed < 3; seed++){
+                        WordMaze maze(word, grid_width, grid_height, 4, 4, seed, true, generator_type);
+                        std::vector<uint8_t> data = maze.serialize();
+                        std::unique_ptr<WordMaze> loaded(WordMaze::deserialize(data.data(), data.size(), 4, 4, true));
+                        maze_count++;
+
+                        const char *problem = NULL;
+                        if(!loaded) problem = "didn't read back";
+                        else if(loaded->word != word) problem = "read back a different word";
+                        else if(loaded->serialize() != data) problem = "stored differently once read back";
+                        else if(loaded->encode_to_png(options) != maze.encode_to_png(options)) problem = "drew differently once read back";
+                        else if(WordMaze::deserialize(data.data(), data.size() - 1, 4, 4, false)) problem = "read back with its last byte missing";
+
+                        std::vector<uint8_t> damaged = data;
+                        damaged[4]++;
+                        if(!problem && WordMaze::deserialize(damaged.data(), damaged.size(), 4, 4, false)) problem = "read back with the wrong version";
+
+                        if(!problem) continue;
+                        fprintf(stderr, "generator %d, %dx%d, \"%s\", seed %d: %s\n", generator_type, grid_width, grid_height, word.c_str(), seed, problem);
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    return failures;
+}
+
+/**
+ * @brief The largest grid a record can hold has more blocks than an int, it should be counted
+ * without overflowing and turned away by decode, and a grid wider than a record holds can't be stored
+ */
+static int check_oversized_grid(){
+    MazeFormat::MazeRecord record;
+    record.grid_width = 1;
+    record.grid_height = 1;
+    record.open_masks.assign(1, direction_bit(North) | direction_bit(South));
+    record.letters.assign(1, 0);
+    record.has_solution = true;
+
+    std::vector<uint8_t> data = MazeFormat::encode(record);
+    MazeFormat::MazeRecord decoded;
+    if(!MazeFormat::decode(data.data(), data.size(), decoded)){
+        fprintf(stderr, "a 1x1 record didn't read back\n");
+        return 1;
+    }
+
+    record.grid_width = record.grid_height = MAZE_RECORD_MAX_GRID_SIZE;
+    if(record.get_block_count() != (size_t)MAZE_RECORD_MAX_GRID_SIZE * MAZE_RECORD_MAX_GRID_SIZE){
+        fprintf(stderr, "a %dx%d record counts %zu blocks\n", record.grid_width, record.grid_height, record.get_block_count());
+        return 1;
+    }
+
+    data[8] = data[9] = data[12] = data[13] = 0xFF;
+    if(MazeFormat::decode(data.data(), data.size(), decoded)){
+        fprintf(stderr, "a %dx%d record read back\n", record.grid_width, record.grid_height);
+        return 1;
+    }
+
+    // Writing one decode would turn away has to fail too, or archives could hold mazes that can't be read
+    record.grid_width = MAZE_RECORD_MAX_GRID_SIZE + 1;
+    record.grid_height = 1;
+    try{
+        MazeFormat::encode(record);
+        fprintf(stderr, "a %dx%d record was stored\n", record.grid_width, record.grid_height);
+        return 1;
+    }catch(std::length_error&){}
+
+    return 0;
+}
+
+/**
+ * @brief Swap the first two words of an archive's index, which find's binary search can't work
+ * with, and check the archive won't open
+ */
+static int check_unsorted_archive(const char *filename){
+    FILE *file = fopen(filename, "rb");
+    std::vector<uint8_t> contents;
+    uint8_t buffer[4096];
+    size_t read_size;
+
+    if(!file) return 1;
+    while((read_size = fread(buffer, 1, sizeof(buffer), file)) > 0) contents.insert(contents.end(), buffer, buffer + read_size);
+    fclose(file);
+
+    size_t index_offset = MazeFormat::read_uint64(contents.data() + 12);
+    std::swap_ranges(contents.begin() + index_offset, contents.begin() + index_offset + MAZE_ARCHIVE_ENTRY_SIZE, contents.begin() + index_offset + MAZE_ARCHIVE_ENTRY_SIZE);
+
+    file = fopen(filename, "wb");
+    if(!file) return 1;
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+
+    MazeFormat::MazeArchive archive;
+    if(!archive.open(filename)) return 0;
+
+    fprintf(stderr, "an archive with its index out of order opened\n");
+    return 1;
+}
+
+/**
+ * @brief Every maze written to an archive should be found again by its word, byte for byte
+ */
+static int check_archive(){
+    const char *filename = "maze_format_test.archive";
+    const std::string words[] = {"zebra", "apple", "maze", "a", "spelling", "apples", "kite"};
+    std::vector<std::vector<uint8_t>> records;
+    int failures = 0;
+
+    MazeFormat::MazeArchiveWriter writer;
+    if(!writer.open(filename)){
+        fprintf(stderr, "couldn't open %s to write\n", filename);
+        return 1;
+    }
+    for(size_t word_index = 0; word_index < sizeof(words) / sizeof(words[0]); word_index++){
+        WordMaze maze(words[word_index], 12, 12, 1, 1, word_index, false, generator_types[word_index % 4]);
+        records.push_back(maze.serialize());
+        writer.add(words[word_index], records.back());
+    }
+    // A word added again keeps the maze it was first added with
+    writer.add(words[1], records[0]);
+    if(!writer.close()){
+        fprintf(stderr, "couldn't write %s\n", filename);
+        return 1;
+    }
+
+    MazeFormat::MazeArchive archive;
+    if(!archive.open(filename)){
+        fprintf(stderr, "couldn't open %s to read\n", filename);
+        remove(filename);
+        return 1;
+    }
+    if(archive.get_entry_count() != (int)records.size()){
+        fprintf(stderr, "the archive has %d entries, expected %d\n", archive.get_entry_count(), (int)records.size());
+        failures++;
+    }
+    for(size_t word_index = 0; word_index < records.size(); word_index++){
+        int entry = archive.find(words[word_index]);
+        size_t record_size = 0;
+        const uint8_t *record = entry == -1 ? NULL : archive.get_record(entry, record_size);
+
+        if(record && std::vector<uint8_t>(record, record + record_size) == records[word_index]) continue;
+        fprintf(stderr, "\"%s\" didn't come back out of the archive\n", words[word_index].c_str());
+        failures++;
+    }
+    if(archive.find("appl") != -1 || archive.find("zebras") != -1){
+        fprintf(stderr, "the archive found a word it doesn't have\n");
+        failures++;
+    }
+
+    archive.close();
+    failures += check_unsorted_archive(filename);
+    remove(filename);
+    return failures;
+}
+
+int main(){
+    int maze_count = 0;
+    int failures = check_round_trips(maze_count);
+
+    failures += check_oversized_grid();
+    failures += check_archive();
+
+    printf("%d failures over %d stored mazes and an archive\n", failures, maze_count);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include "../include/pixel_kernels.hpp"
+#include "../include/utils.hpp"
+#include <cstdio>
+#include <vector>
+
+using namespace PixelKernels;
+
+// Long enough to run every vector loop several times and leave every possible tail after it
+static const size_t max_count = 150;
+// Misaligning the buffers by up to this many bytes keeps the unaligned loads honest
+static const size_t max_offset = 7;
+
+typedef void (*FillPixels)(uint8_t*, uint32_t, size_t);
+typedef void (*RgbaToRgb)(const uint8_t*, uint8_t*, size_t);
+typedef void (*PaletteIndexes)(const uint8_t*, size_t, const uint32_t*, int, uint8_t*);
+typedef void (*PackSamples)(const uint8_t*, size_t, int, uint8_t*);
+
+/**
+ * @brief One version of every kernel and the instruction set it needs
+ */
+struct KernelVersion{
+    const char *name;
+    InstructionSet instruction_set;
+    FillPixels fill_pixels;
+    RgbaToRgb rgba_to_rgb;
+    PaletteIndexes palette_indexes;
+    PackSamples pack_samples;
+};
+
+// Kernels without a version for an instruction set fall back to the one below it, as the dispatch does
+static const KernelVersion versions[] = {
+#ifdef PIXEL_KERNELS_X86
+    {"sse2", SSE2, fill_pixels_sse2, rgba_to_rgb_scalar, palette_indexes_sse2, pack_samples_scalar},
+    {"ssse3", SSSE3, fill_pixels_sse2, rgba_to_rgb_ssse3, palette_indexes_sse2, pack_samples_ssse3},
+    {"avx2", AVX2, fill_pixels_avx2, rgba_to_rgb_avx2, palette_indexes_avx2, pack_samples_avx2},
+#endif
+    {"dispatched", Scalar, fill_pixels, rgba_to_rgb, palette_indexes, pack_samples}
+};
+
+/**
+ * @brief Maze like pixels, runs of colours from the palette with the odd colour that isn't in it and
+ * alphas that should be ignored
+ */
+static std::vector<uint8_t> make_pixels(RandomContext &random, const uint32_t *palette, int palette_size, size_t count){
+    std::vector<uint8_t> pixels(count * 4);
+    uint32_t pixel = palette[0];
+
+    for(size_t index = 0; index < count; index++){
+        if(random.get_rand_int(0, 3) == 0) pixel = palette[random.get_rand_int(0, palette_size - 1)];
+        if(random.get_rand_int(0, 15) == 0) pixel = pack_pixel(random.get_rand_int(0, 255), random.get_rand_int(0, 255), random.get_rand_int(0, 255), 0);
+
+        uint32_t written = pixel | pack_pixel(0, 0, 0, random.get_rand_int(0, 255));
+        memcpy(pixels.data() + index * 4, &written, 4);
+    }
+
+    return pixels;
+}
+
+/**
+ * @brief Run a kernel into a buffer with guard bytes after it, which should come back untouched
+ */
+template<typename Kernel>
+static std::vector<uint8_t> run_guarded(size_t offset, size_t size, Kernel kernel){
+    std::vector<uint8_t> buffer(offset + size + 64, 0xA5);
+    kernel(buffer.data() + offset);
+    return buffer;
+}
+
+/**
+ * @brief Every version this CPU can run should write exactly the bytes the plain version does
+ */
+int main(){
+    RandomContext random(1);
+    int failures = 0, checks = 0;
+
+    for(size_t count = 0; count <= max_count; count++){
+        for(size_t offset = 0; offset <= max_offset; offset++){
+            uint32_t palette[PIXEL_KERNELS_MAX_VECTOR_PALETTE];
+            int palette_size = 1 + (count + offset) % PIXEL_KERNELS_MAX_VECTOR_PALETTE;
+            for(int palette_index = 0; palette_index < palette_size; palette_index++){
+                palette[palette_index] = pack_pixel(random.get_rand_int(0, 255), random.get_rand_int(0, 255), random.get_rand_int(0, 255), 0);
+            }
+
+            std::vector<uint8_t> pixels = make_pixels(random, palette, palette_size, count);
+            std::vector<uint8_t> source(offset + pixels.size());
+            std::copy(pixels.begin(), pixels.end(), source.begin() + offset);
+            const uint8_t *source_pixels = source.data() + offset;
+            uint32_t pixel = pack_pixel(count, offset, 7, 200);
+
+            const int bit_depths[] = {1, 2, 4};
+            std::vector<uint8_t> samples[3];
+            for(int depth_index = 0; depth_index < 3; depth_index++){
+                for(size_t index = 0; index < count; index++) samples[depth_index].push_back(random.get_rand_int(0, (1 << bit_depths[depth_index]) - 1));
+            }
+
+            for(const KernelVersion &version: versions){
+                if(version.instruction_set > get_instruction_set()) continue;
+
+                std::vector<uint8_t> expected = run_guarded(offset, count * 4, [&](uint8_t *dest){ fill_pixels_scalar(dest, pixel, count); });
+                std::vector<uint8_t> actual = run_guarded(offset, count * 4, [&](uint8_t *dest){ version.fill_pixels(dest, pixel, count); });
+                if(actual != expected){
+                    fprintf(stderr, "%s fill_pixels differs with %zu pixels at offset %zu\n", version.name, count, offset);
+                    failures++;
+                }
+
+                expected = run_guarded(offset, count * 3, [&](uint8_t *dest){ rgba_to_rgb_scalar(source_pixels, dest, count); });
+                actual = run_guarded(offset, count * 3, [&](uint8_t *dest){ version.rgba_to_rgb(source_pixels, dest, count); });
+                if(actual != expected){
+                    fprintf(stderr, "%s rgba_to_rgb differs with %zu pixels at offset %zu\n", version.name, count, offset);
+                    failures++;
+                }
+
+                expected = run_guarded(offset, count, [&](uint8_t *dest){ palette_indexes_scalar(source_pixels, count, palette, palette_size, dest); });
+                actual = run_guarded(offset, count, [&](uint8_t *dest){ version.palette_indexes(source_pixels, count, palette, palette_size, dest); });
+                if(actual != expected){
+                    fprintf(stderr, "%s palette_indexes differs with %zu pixels at offset %zu and %d colours\n", version.name, count, offset, palette_size);
+                    failures++;
+                }
+
+                for(int depth_index = 0; depth_index < 3; depth_index++){
+                    int bit_depth = bit_depths[depth_index];
+                    const uint8_t *depth_samples = samples[depth_index].data();
+                    size_t row_size = (count * bit_depth + 7) / 8;
+
+                    expected = run_guarded(offset, row_size, [&](uint8_t *row){ pack_samples_scalar(depth_samples, count, bit_depth, row); });
+                    actual = run_guarded(offset, row_size, [&](uint8_t *row){ version.pack_samples(depth_samples, count, bit_depth, row); });
+                    if(actual != expected){
+                        fprintf(stderr, "%s pack_samples differs with %zu samples of %d bits at offset %zu\n", version.name, count, bit_depth, offset);
+                        failures++;
+                    }
+                }
+                checks += 6;
+            }
+        }
+    }
+
+    printf("%d of %d checks failed, this CPU runs %s\n", failures, checks, get_instruction_set_name());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#include <string>
+#include "../include/map.hpp"
+
+#ifndef TEST_MAZES_H
+#define TEST_MAZES_H
+
+/**
+ * @brief Every generator, so each test sweeps all of them
+ */
+static const GeneratorType generator_types[] = {GrowingTree, Backtracker, Wilson, Kruskal};
+
+/**
+ * @brief Read the word back off the solution path, one letter after each junction on it
+ */
+static std::string read_word(WordMaze &maze){
+    std::string read;
+    for(int path_index = 0; path_index < maze.solution_path->curr_path_len - 1; path_index++){
+        if(maze.solution_path->path[path_index]->is_mulit_exit()) read += maze.solution_path->path[path_index + 1]->get_letter();
+    }
+    return read;
+}
+
+#endif
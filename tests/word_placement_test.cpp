@@ -0,0 +1,36 @@
+#include "test_mazes.hpp"
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief Over a sweep of seeds at the default grid size, every word should be spelled along the
+ * solution path, and the same seed should always give the same maze
+ */
+int main(){
+    const std::string words[] = {"a", "at", "cat", "maze", "spell", "letters", "spelling", "alphabetical", "encyclopedia", "extraordinarily"};
+    int failures = 0, maze_count = 0;
+
+    for(GeneratorType generator_type: generator_types){
+        for(const std::string &word: words){
+            if(!WordMaze::word_fits(word.length(), 20, 20)) continue;
+
+            for(int seed = 0; seed < 50; seed++){
+                WordMaze maze(word, 20, 20, 1, 1, seed, false, generator_type);
+                maze_count++;
+
+                std::string read = read_word(maze);
+                if(read != word){
+                    fprintf(stderr, "generator %d, \"%s\", seed %d: read \"%s\"\n", generator_type, word.c_str(), seed, read.c_str());
+                    failures++;
+                }
+                else if(seed % 10 == 0 && WordMaze(word, 20, 20, 1, 1, seed, false, generator_type).serialize() != maze.serialize()){
+                    fprintf(stderr, "generator %d, \"%s\", seed %d: a second maze from the seed differs\n", generator_type, word.c_str(), seed);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    printf("%d of %d mazes failed\n", failures, maze_count);
+    return failures ? 1 : 0;
+}